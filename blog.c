@@ -0,0 +1,79 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  BLOG text or binary records, see blog.h
+ */
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include "logsink.h"
+#include "blog.h"
+
+#ifdef BLOG_BINARY
+ #define BLOG_FMT(id, level, sig, fmt) static IROM char blog_##id[]=sig;
+#else
+ #define BLOG_FMT(id, level, sig, fmt) static IROM char blog_##id[]=fmt;
+#endif
+#include "blog-formats.def"
+#undef BLOG_FMT
+#define BLOG_FMT(id, level, sig, fmt) blog_##id,
+static const char *const blog_table[BLOG_FORMATS] IROM_TABLE={
+#include "blog-formats.def"
+};
+#undef BLOG_FMT
+#define BLOG_FMT(id, level, sig, fmt) LOG_LEVEL_##level,
+static const uint8_t blog_level[BLOG_FORMATS]={
+#include "blog-formats.def"
+};
+#undef BLOG_FMT
+
+#ifdef BLOG_BINARY
+
+static int put32(uint8_t *rec, int n, uint32_t v) {
+    rec[n]=v; rec[n+1]=v>>8; rec[n+2]=v>>16; rec[n+3]=v>>24;
+    return n+4;
+}
+
+void blog(int id, ...) {
+    uint8_t rec[BLOG_RECORD];
+    int     n=BLOG_HEADER, len;
+    union {float f; uint32_t u;} v;
+    const char *sig, *s;
+    char    sigs[16];
+    va_list args;
+
+    irom_strcpy(sigs, blog_table[id], sizeof(sigs));
+    va_start(args, id);
+    for (sig=sigs; *sig; sig++) {
+        if (n+4>BLOG_RECORD) break;
+        switch (*sig) {
+            case 'f': v.f=(float)va_arg(args, double); n=put32(rec,n,v.u); break;
+            case 'd':
+            case 'u': n=put32(rec,n,va_arg(args, uint32_t)); break;
+            case 's':
+                s=va_arg(args, const char*);
+                len=strlen(s);
+                if (len>BLOG_RECORD-n-1) len=BLOG_RECORD-n-1;
+                rec[n++]=len;
+                memcpy(rec+n,s,len); n+=len;
+                break;
+        }
+    }
+    va_end(args);
+    rec[0]=id; rec[1]=n;
+    put32(rec,2,xTaskGetTickCount()*portTICK_PERIOD_MS);
+    log_put(blog_level[id], LOG_BINARY, rec, n);
+}
+#else
+void blog(int id, ...) {
+    char line[LOG_LINE], fmt[LOG_LINE];
+    va_list args;
+    irom_strcpy(fmt, blog_table[id], sizeof(fmt));
+    va_start(args, id);
+    int n=vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (n<0) return;
+    if (n>=(int)sizeof(line)) n=sizeof(line)-1; //truncated
+    log_put(blog_level[id], LOG_TEXT, line, n);
+}
+#endif
@@ -0,0 +1,25 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  BLOG(id, ...) logs with a format from blog-formats.def
+ *  by default it formats the line into the log sink like LOG_I and friends
+ *  compiled with BLOG_BINARY the formats stay out of the firmware: a record with the format id,
+ *  a millisecond timestamp and the raw arguments goes into the log sink, which sends it to UDP port BLOG_PORT
+ *  use tools/blogdecode to turn the records back into text
+ */
+#ifndef __BLOG_H__
+#define __BLOG_H__
+
+#define BLOG_PORT    45679
+#define BLOG_RECORD     64 //max bytes per record, strings get truncated to fit
+#define BLOG_HEADER      6 //id, length, 32 bit little endian timestamp in ms
+
+#define BLOG_FMT(id, level, sig, fmt) BLOG_##id,
+enum {
+#include "blog-formats.def"
+    BLOG_FORMATS
+};
+#undef BLOG_FMT
+
+void blog(int id, ...);
+#define BLOG(id, ...) blog(BLOG_##id, ##__VA_ARGS__)
+
+#endif // __BLOG_H__
@@ -0,0 +1,32 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Compile time memory budget of the application
+ *  steady state operation does no heap allocations: buffers are static and reserved at link time,
+ *  task stacks and queues are allocated once during init and never freed
+ *  lwIP, HomeKit and wolfSSL manage their own memory and are not part of this budget
+ */
+#ifndef __BUDGET_H__
+#define __BUDGET_H__
+
+#include "mqtt-client.h"
+#include "ota-api.h"
+#include "scheduler.h"
+#include "logsink.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "profile.h"
+#include "soak.h"
+
+#define SCHED_STACK       512 //words, formatting and publishing is done by publish_task
+#define PUBLISH_STACK     512 //words
+#define NETINIT_STACK     512 //words, freed again once the network is up
+#define SCHED_QUEUE_BYTES  (SCHED_QUEUE_SIZE*sizeof(sched_msg_t))
+
+#define BUDGET_STATIC (MQTT_MSG_LEN + MQTT_BUF_LEN + OTA_STRING_LEN + OTA_REPO_LEN + OTA_VERSION_LEN + OTA_SERIAL_LEN \
+                     + LOG_RING + LOG_PACKET + TELEMETRY_RING*sizeof(telemetry_t) + TRACE_RAM \
+                     + PROFILE_RAM + SOAK_RAM)
+#define BUDGET_INIT   ((SCHED_STACK + MQTT_STACK + PUBLISH_STACK + LOG_STACK + SOAK_STACK)*4 + MQTT_QUEUE_SIZE*MQTT_MSG_LEN + SCHED_QUEUE_BYTES)
+#define BUDGET_MAX   14336 //bytes
+
+_Static_assert(BUDGET_STATIC+BUDGET_INIT <= BUDGET_MAX, "application memory budget exceeded, see budget.h");
+
+#endif // __BUDGET_H__
@@ -0,0 +1,80 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  The pump decision logic as it used to live in state_task
+ */
+#include <math.h>
+#include <string.h>
+#include "control.h"
+
+void control_init(control_t *c, const control_param_t *param) {
+    memset(c, 0, sizeof(*c));
+    c->param=param;
+    c->on=true;
+    c->timer=param->run;
+    c->sample_min=100;
+    c->delta1=0.0625;
+}
+
+static void decide(control_t *c) {
+    const control_param_t *p=c->param;
+    if (c->in_ok) { //do not change state if broken input
+        if (c->t_in>p->setpoint+p->hysteresis/2) c->on=true;
+        if (c->t_in<p->setpoint-p->hysteresis/2) c->on=false;
+    }
+}
+
+static void overrule(control_t *c, int inhibit) {
+    c->inhibited=c->timed=false;
+    if (inhibit) {
+        c->on=false;
+        c->inhibited=true;
+    }
+    if (c->timer<=c->param->run) {
+        c->on=true;
+        c->timed=true;
+    }
+}
+
+bool control_beat(control_t *c, float t_in, float t_out, int inhibit) {
+    const control_param_t *p=c->param;
+    
+    c->timer-=p->beat;
+    if (c->timer<=0) {
+        c->timer=p->repeat;
+        c->on=false;
+    }
+    c->t_out=isnan(t_out)?CONTROL_NO_TEMP:t_out;
+    c->t_in =isnan(t_in) ?CONTROL_NO_TEMP:t_in;
+    c->in_ok=!isnan(t_in);
+    c->out_ok=!isnan(t_out);
+    decide(c);
+    if (c->on) c->prev_on_time+=p->beat; else c->prev_on_time=0;
+    if (c->prev_on_time>p->run) c->timer=p->repeat;
+    overrule(c, inhibit);
+    
+    //if pump is actived and return temp does not drop by >0.1 degrees in 120s then pump might be broken!
+    c->delta_ready=false;
+    if ( !c->prev_on && c->on ) {
+        c->sample_max=-100; c->sample_min=100; //the first valid sample sets both
+        c->sampletimer=p->run+p->beat; //beats during which we are taking samples
+    }
+    if (c->sampletimer) { //delta is between the MIN and the MAX of the samples, not just the start value
+        if (c->out_ok && c->t_out<c->sample_min) c->sample_min=c->t_out;
+        if (c->out_ok && c->t_out>c->sample_max) c->sample_max=c->t_out;
+        c->sampletimer-=p->beat;
+        if (!c->sampletimer && c->sample_max>=c->sample_min) { //sampling is done, without any valid sample it is skipped
+            c->delta_out=c->sample_max-c->sample_min;
+            c->delta_ready=true;
+            float d=c->delta_out>1.0?1.0:c->delta_out; //not interested in bigger values
+            c->delta_sum=c->delta5+c->delta4+c->delta3+c->delta2+c->delta1+d;
+            c->delta5=c->delta4; c->delta4=c->delta3; c->delta3=c->delta2; c->delta2=c->delta1; c->delta1=d; 
+        } 
+    }
+    c->prev_on=c->on; //store state for next round
+    return c->on;
+}
+
+bool control_apply(control_t *c, int inhibit) {
+    decide(c);
+    overrule(c, inhibit);
+    return c->on;
+}
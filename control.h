@@ -0,0 +1,42 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  The pump decision logic, free of any ESP dependency so it can also be compiled on a host
+ *  control_beat is called once every beat with fresh temperatures (NAN if a sensor failed)
+ *  control_apply re-evaluates between beats, e.g. after a button press, without advancing the timers
+ *  both return the new relay state
+ */
+#ifndef __CONTROL_H__
+#define __CONTROL_H__
+
+#include <stdbool.h>
+
+#define CONTROL_NO_TEMP 99.99F //t_in or t_out of a failed sensor, as the log shows it
+#define BEAT 10                //in seconds, the param.beat of main.c
+
+typedef struct control_param {
+    float setpoint;   //degrees, incoming temperature above setpoint+hysteresis/2 switches on
+    float hysteresis; //degrees
+    int   beat;       //seconds between two calls of control_beat
+    int   repeat;     //seconds after which the pump is exercised if it did not run
+    int   run;        //seconds of an exercise run
+} control_param_t;
+
+typedef struct control {
+    const control_param_t *param;
+    bool  on, prev_on;
+    bool  in_ok;      //t_in is a valid reading
+    bool  out_ok;     //t_out is a valid reading, else it stays out of the delta_out sampling
+    bool  inhibited;  //last decision was overruled by an inhibit
+    bool  timed;      //last decision was overruled by the repeat timer
+    bool  delta_ready;//sampling of delta_out finished in this beat
+    int   timer, prev_on_time, sampletimer;
+    float t_in, t_out;
+    float sample_max, sample_min, delta_out; //delta_out is the unclipped result of the last sampling
+    float delta_sum;  //of the last six clipped delta_out values
+    float delta5, delta4, delta3, delta2, delta1;
+} control_t;
+
+void control_init(control_t *c, const control_param_t *param);
+bool control_beat(control_t *c, float t_in, float t_out, int inhibit);
+bool control_apply(control_t *c, int inhibit);
+
+#endif // __CONTROL_H__
@@ -0,0 +1,107 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  CPU frequency governor, see cpufreq.h
+ */
+#include <stdbool.h>
+#include <espressif/esp_system.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include "scheduler.h"
+#include "logsink.h"
+#include "cpufreq.h"
+#include "trace.h"
+
+cpufreq_counters_t cpufreq;
+static uint32_t held, held_since[CPUFREQ_REASONS]; //bit per reason, ms when it was last taken
+static uint8_t  holds[CPUFREQ_REASONS];            //a reason is held while it was taken more often than released
+static const uint16_t limit[CPUFREQ_REASONS]=CPUFREQ_LIMITS;
+static uint8_t  pinned;
+static bool high;
+
+static uint32_t now_ms(void) {
+    return xTaskGetTickCount()*portTICK_PERIOD_MS;
+}
+
+static void account(uint32_t now) { //the time since the last switch goes to the frequency it ran at
+    if (high) cpufreq.ms_high+=now-cpufreq.since;
+    else      cpufreq.ms_low +=now-cpufreq.since;
+    cpufreq.since=now;
+}
+
+static void apply(void) { //called in a critical section
+#ifdef CPUFREQ
+    bool want=held!=0;
+    if (want==high || pinned) return; //cpufreq_unpin comes back here
+    account(now_ms());
+    high=want;
+    if (high) cpufreq.boosts++;
+    if (high) TRACE_MARK(CPU_HIGH); else TRACE_MARK(CPU_LOW); //trace2json takes the cycles after it at the new rate
+    sdk_system_update_cpu_freq(high ? CPUFREQ_HIGH : CPUFREQ_LOW);
+#endif
+}
+
+static void expire_job(void *arg);
+static sched_job_t expirer=SCHED_JOB(expire_job,NULL);
+
+static void expire_job(void *arg) {
+    uint32_t now=now_ms();
+    taskENTER_CRITICAL();
+    for (int i=0; i<CPUFREQ_REASONS; i++) {
+        if ((held&1<<i) && now-held_since[i]>=limit[i]*1000) {held&=~(1<<i); holds[i]=0; cpufreq.expired++;}
+    }
+    apply();
+    taskEXIT_CRITICAL();
+    if (!held) sched_cancel(&expirer);
+}
+
+void cpufreq_hold(int reason) {
+    bool first;
+    taskENTER_CRITICAL();
+    first=!held;
+    if (holds[reason]<UINT8_MAX) holds[reason]++;
+    held|=1<<reason;
+    held_since[reason]=now_ms();
+    apply();
+    taskEXIT_CRITICAL();
+    if (first) sched_add(&expirer, CPUFREQ_CHECK*1000, CPUFREQ_CHECK*1000);
+}
+
+void cpufreq_release(int reason) {
+    taskENTER_CRITICAL();
+    if (holds[reason] && !--holds[reason]) held&=~(1<<reason); //more releases than holds stop at 0
+    apply();
+    taskEXIT_CRITICAL();
+}
+
+void cpufreq_pin(void) {
+    taskENTER_CRITICAL();
+    pinned++;
+    taskEXIT_CRITICAL();
+}
+
+void cpufreq_unpin(void) {
+    taskENTER_CRITICAL();
+    if (pinned) pinned--;
+    apply(); //what was held or released meanwhile
+    taskEXIT_CRITICAL();
+}
+
+void cpufreq_report(void) {
+    uint32_t total, permille;
+    taskENTER_CRITICAL();
+    account(now_ms());
+    taskEXIT_CRITICAL();
+    total=cpufreq.ms_low+cpufreq.ms_high;
+    permille=total ? (uint64_t)cpufreq.ms_high*1000/total : 0;
+    LOG_I("cpufreq: %u ms at %d MHz, %u ms at %d MHz = %u.%u%%, %u boosts, %u expired, now %d MHz\n",
+            cpufreq.ms_low, CPUFREQ_LOW, cpufreq.ms_high, CPUFREQ_HIGH, permille/10, permille%10,
+            cpufreq.boosts, cpufreq.expired, sdk_system_get_cpu_freq());
+    cpufreq.ms_low=cpufreq.ms_high=cpufreq.boosts=cpufreq.expired=0;
+}
+
+void cpufreq_init(void) {
+    held=0; high=false;
+#ifdef CPUFREQ
+    sdk_system_update_cpu_freq(CPUFREQ_LOW);
+#endif
+    cpufreq.since=now_ms();
+}
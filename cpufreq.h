@@ -0,0 +1,41 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  CPU frequency governor: 160 MHz while a reason holds it, 80 MHz otherwise
+ *  HomeKit pair-setup and pair-verify hold it from the client connect until it is verified or paired,
+ *  an OTA image holds it from verify_init until verify_final, so the hashing of the chunks runs at double speed
+ *  holds are counted per reason, so one HomeKit client that is verified does not end the pair-verify of another
+ *  a reason that is not released within its limit of the last hold is dropped, so a client that goes silent cannot
+ *  keep the clock up
+ *  the FreeRTOS tick and sdk_os_delay_us follow the clock, FRC1 and the UARTs run from the 80 MHz APB and do not
+ *  the CCOUNT cycle counter follows the clock too: while pinned (ow.c during a 1-Wire transaction) a switch waits
+ *  for the unpin, and with TRACE every switch puts a CPU_LOW or CPU_HIGH mark into the trace just before it
+ *  without CPUFREQ the holds are kept but the clock stays at 80 MHz, so all time counts as low and there are no boosts
+ */
+#ifndef __CPUFREQ_H__
+#define __CPUFREQ_H__
+
+#include <stdint.h>
+
+#define CPUFREQ_LOW    80
+#define CPUFREQ_HIGH  160
+#define CPUFREQ_CHECK   5 //s between checks for expired holds while any is taken
+
+enum {CPUFREQ_HOMEKIT, CPUFREQ_OTA, CPUFREQ_REASONS};
+#define CPUFREQ_LIMITS {60, 600} //s per reason, a pair-setup takes about 20 s at 160 MHz
+
+typedef struct cpufreq_counters {
+    uint32_t ms_low, ms_high; //time spent at each frequency
+    uint32_t boosts;          //switches to CPUFREQ_HIGH
+    uint32_t expired;         //holds dropped at their limit
+    uint32_t since;           //ms of the last switch or report
+} cpufreq_counters_t;
+
+extern cpufreq_counters_t cpufreq;
+
+void cpufreq_init(void);
+void cpufreq_hold(int reason);
+void cpufreq_release(int reason);
+void cpufreq_pin(void);    //no switch until the matching unpin, for code that times with CCOUNT
+void cpufreq_unpin(void);
+void cpufreq_report(void); //logs the counters and starts a new period
+
+#endif // __CPUFREQ_H__
@@ -0,0 +1,211 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Streaming patcher for delta OTA images, see delta.h
+ */
+#include <stdbool.h>
+#include <string.h>
+#include "delta.h"
+
+#ifdef DELTA_HOST //tools/delta provides a flash emulator
+bool delta_flash_read(uint32_t addr, uint8_t *buf, uint32_t size);
+bool delta_flash_write(uint32_t addr, const uint8_t *buf, uint32_t size);
+bool delta_flash_erase(uint32_t addr);
+#else
+#include <spiflash.h>
+#define delta_flash_read  spiflash_read
+#define delta_flash_write spiflash_write
+#define delta_flash_erase spiflash_erase_sector
+#endif
+
+enum {ST_HEADER, ST_OP, ST_ARG, ST_DATA, ST_ZEROS, ST_RUN, ST_BYTES, ST_DONE, ST_ERROR};
+
+uint32_t delta_crc32(uint32_t crc, const uint8_t *data, int len) {
+    static const uint32_t nibble[16]={
+        0x00000000,0x1db71064,0x3b6e20c8,0x26d930ac,0x76dc4190,0x6b6b51f4,0x4db26158,0x5005713c,
+        0xedb88320,0xf00f9344,0xd6d6a3e8,0xcb61b38c,0x9b64c2b0,0x86d3d2d4,0xa00ae278,0xbdbdf21c};
+    crc=~crc;
+    while (len--) {
+        crc^=*data++;
+        crc=(crc>>4)^nibble[crc&15];
+        crc=(crc>>4)^nibble[crc&15];
+    }
+    return ~crc;
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return p[0] | p[1]<<8 | p[2]<<16 | (uint32_t)p[3]<<24;
+}
+
+static int fail(delta_t *d, int error) {
+    if (d->verify) verify_abort(d->verify); //the image will not be booted, no need to hash at 160 MHz
+    d->state=ST_ERROR;
+    return d->error=error;
+}
+
+static bool unchanged(uint32_t addr, const uint8_t *data, int len) { //applying in place leaves most sectors as they are
+    uint32_t flash[16];
+    for (int n; len>0; addr+=n, data+=n, len-=n) {
+        n=len<(int)sizeof(flash) ? len : (int)sizeof(flash);
+        if (!delta_flash_read(addr, (uint8_t*)flash, n) || memcmp(flash, data, n)) return false;
+    }
+    return true;
+}
+
+static int flush(delta_t *d, int len) { //the sector that holds written-1
+    uint32_t addr=d->new_base+((d->written-1)&~(DELTA_SECTOR-1));
+    if (d->verify && verify_update(d->verify, d->sector, len)) return fail(d, DELTA_ERR_VERIFY); //in order, no second pass
+    while (len&3) d->sector[len++]=0xff;
+    if (unchanged(addr, d->sector, len)) {
+        d->skipped++;
+        return DELTA_OK;
+    }
+    if (!delta_flash_erase(addr) || !delta_flash_write(addr, d->sector, len)) return fail(d, DELTA_ERR_FLASH);
+    d->erased++;
+    return DELTA_OK;
+}
+
+static int advance(delta_t *d, int n) {
+    d->written+=n;
+    if (!(d->written&(DELTA_SECTOR-1))) return flush(d, DELTA_SECTOR);
+    return DELTA_OK;
+}
+
+static int put_old(delta_t *d, uint32_t n) { //n bytes of the old image at src
+    while (n) {
+        uint32_t pos=d->written&(DELTA_SECTOR-1), chunk=DELTA_SECTOR-pos;
+        if (chunk>n) chunk=n;
+        if (!delta_flash_read(d->old_base+d->src, d->sector+pos, chunk)) return fail(d, DELTA_ERR_FLASH);
+        d->src+=chunk; d->left-=chunk; n-=chunk;
+        if (advance(d, chunk)) return d->error;
+    }
+    return DELTA_OK;
+}
+
+static int check_base(delta_t *d) {
+    uint32_t crc=0, n;
+    if (get32(d->header)!=DELTA_MAGIC) return fail(d, DELTA_ERR_MAGIC);
+    d->old_len=get32(d->header+4);
+    d->new_len=get32(d->header+8);
+    if (d->new_len>d->max_len) return fail(d, DELTA_ERR_RANGE);
+    for (uint32_t addr=0; addr<d->old_len; addr+=n) { //the sector buffer is free until the first op
+        n=d->old_len-addr<DELTA_SECTOR ? d->old_len-addr : DELTA_SECTOR;
+        if (!delta_flash_read(d->old_base+addr, d->sector, n)) return fail(d, DELTA_ERR_FLASH);
+        crc=delta_crc32(crc, d->sector, n);
+    }
+    if (crc!=get32(d->header+12)) return fail(d, DELTA_ERR_BASE);
+    return DELTA_OK;
+}
+
+static int start_op(delta_t *d) { //all arguments are decoded
+    if (d->op==DELTA_DATA) {
+        d->left=d->arg[0];
+    } else {
+        d->src=d->arg[0]; d->left=d->arg[1];
+        if (d->src>d->old_len || d->left>d->old_len-d->src) return fail(d, DELTA_ERR_RANGE);
+    }
+    if (d->left>d->new_len-d->written) return fail(d, DELTA_ERR_RANGE);
+    if (d->op==DELTA_COPY) {
+        if (put_old(d, d->left)) return d->error;
+        d->state=ST_OP;
+    } else d->state=d->op==DELTA_DATA ? ST_DATA : ST_ZEROS;
+    if (!d->left) d->state=ST_OP;
+    return DELTA_OK;
+}
+
+static int varint_done(delta_t *d) { //a complete varint is in d->varint
+    uint32_t v=d->varint;
+    d->varint=d->shift=0;
+    switch (d->state) {
+        case ST_ARG:
+            d->arg[d->fill++]=v;
+            if (d->fill==(d->op==DELTA_DATA ? 1 : 2)) return start_op(d);
+            return DELTA_OK;
+        case ST_ZEROS:
+            if (v>d->left) return fail(d, DELTA_ERR_RANGE);
+            if (put_old(d, v)) return d->error;
+            d->state=d->left ? ST_RUN : ST_OP;
+            return DELTA_OK;
+        case ST_RUN:
+            if (!v || v>d->left) return fail(d, DELTA_ERR_RANGE);
+            d->run=v; d->fill=0; //fill counts what is left of the old bytes already in the sector buffer
+            d->state=ST_BYTES;
+            return DELTA_OK;
+    }
+    return fail(d, DELTA_ERR_OP);
+}
+
+void delta_init(delta_t *d, uint32_t old_base, uint32_t new_base, uint32_t max_len) {
+    memset(d, 0, sizeof(delta_t)-DELTA_SECTOR);
+    d->old_base=old_base;
+    d->new_base=new_base;
+    d->max_len =max_len;
+    d->state   =ST_HEADER;
+}
+
+int delta_feed(delta_t *d, const uint8_t *data, int len) {
+    while (len>0) {
+        uint8_t b;
+        uint32_t pos, n;
+        switch (d->state) {
+            case ST_HEADER:
+                n=DELTA_HEADER-d->fill;
+                if (n>(uint32_t)len) n=len;
+                memcpy(d->header+d->fill, data, n);
+                d->fill+=n; data+=n; len-=n;
+                if (d->fill==DELTA_HEADER) {
+                    if (check_base(d)) return d->error;
+                    d->state=ST_OP;
+                }
+                break;
+            case ST_OP:
+                d->op=*data++; len--;
+                d->fill=0;
+                if (d->op==DELTA_END) d->state=ST_DONE;
+                else if (d->op<=DELTA_DATA) d->state=ST_ARG;
+                else return fail(d, DELTA_ERR_OP);
+                break;
+            case ST_ARG: case ST_ZEROS: case ST_RUN:
+                b=*data++; len--;
+                if (d->shift>28) return fail(d, DELTA_ERR_OP);
+                d->varint|=(uint32_t)(b&0x7f)<<d->shift;
+                d->shift+=7;
+                if (!(b&0x80) && varint_done(d)) return d->error;
+                break;
+            case ST_DATA:
+                pos=d->written&(DELTA_SECTOR-1);
+                n=DELTA_SECTOR-pos;
+                if (n>d->left) n=d->left;
+                if (n>(uint32_t)len) n=len;
+                memcpy(d->sector+pos, data, n);
+                data+=n; len-=n; d->left-=n;
+                if (advance(d, n)) return d->error;
+                if (!d->left) d->state=ST_OP;
+                break;
+            case ST_BYTES: //difference bytes are added to the old bytes, read per piece of the sector buffer
+                pos=d->written&(DELTA_SECTOR-1);
+                if (!d->fill) {
+                    n=DELTA_SECTOR-pos;
+                    if (n>d->run) n=d->run;
+                    if (!delta_flash_read(d->old_base+d->src, d->sector+pos, n)) return fail(d, DELTA_ERR_FLASH);
+                    d->fill=n;
+                }
+                d->sector[pos]+=*data++; len--;
+                d->src++; d->left--; d->run--; d->fill--;
+                if (advance(d, 1)) return d->error;
+                if (!d->run) d->state=d->left ? ST_ZEROS : ST_OP;
+                break;
+            case ST_DONE:
+                return DELTA_OK; //trailing bytes, e.g. padding, are ignored
+            default:
+                return d->error;
+        }
+    }
+    return d->state==ST_DONE ? DELTA_OK : DELTA_MORE;
+}
+
+int delta_finish(delta_t *d) {
+    if (d->state==ST_ERROR) return d->error;
+    if (d->state!=ST_DONE)  return fail(d, DELTA_ERR_OP);
+    if (d->written!=d->new_len) return fail(d, DELTA_ERR_RANGE);
+    if ((d->written&(DELTA_SECTOR-1)) && flush(d, d->written&(DELTA_SECTOR-1))) return d->error;
+    return d->new_len;
+}
@@ -0,0 +1,53 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Streaming patcher for delta OTA images made by tools/delta
+ *  the patch is fed in whatever chunks the download delivers, the new image is assembled one flash sector
+ *  at a time from ranges of the old image in flash and literal bytes, so RAM use is sizeof(delta_t) whatever the size
+ *  patch: header {magic, old_len, new_len, old_crc32} then ops, all numbers little endian or LEB128 varints
+ *    COPY old_offset len                  len bytes of the old image
+ *    ADD  old_offset len {zeros n bytes}  old bytes plus a sparse difference, so moved code with changed addresses is cheap
+ *    DATA len bytes                       literal bytes
+ *    END
+ *  sectors that already hold the right bytes are not erased and written again
+ *  old and new may be the same flash area if the patch was made with tools/delta -i, which never reads old bytes
+ *  from a sector that was already rewritten
+ */
+#ifndef __DELTA_H__
+#define __DELTA_H__
+
+#include <stdint.h>
+#include "verify.h"
+
+#define DELTA_MAGIC  0x31544c44 //"DLT1"
+#define DELTA_HEADER 16
+#define DELTA_SECTOR 4096
+
+enum {DELTA_COPY=1, DELTA_ADD, DELTA_DATA, DELTA_END=0};
+
+#define DELTA_OK          0
+#define DELTA_MORE        1 //feed more patch bytes
+#define DELTA_ERR_MAGIC  -1
+#define DELTA_ERR_BASE   -2 //the old image is not the one the patch was made from
+#define DELTA_ERR_RANGE  -3 //op outside the old or new image
+#define DELTA_ERR_OP     -4
+#define DELTA_ERR_FLASH  -5
+#define DELTA_ERR_VERIFY -6 //the new image grew beyond the length in its sig
+
+typedef struct delta {
+    uint32_t old_base, new_base, max_len;   //flash addresses and room for the new image
+    uint32_t old_len, new_len, written;     //written is what is in flash or in the sector buffer
+    uint8_t  header[DELTA_HEADER];
+    int      state, op, fill, error;
+    uint32_t varint, shift, arg[2];         //varint being decoded and the decoded op arguments
+    uint32_t src, left, run;                //old image position, bytes left in the op and in the current run
+    uint32_t erased, skipped;               //sectors written and sectors that already had the right contents
+    verify_t *verify;                       //optional, set after delta_init to hash the new image as it is flushed
+    uint8_t  sector[DELTA_SECTOR];
+} delta_t;
+
+void delta_init(delta_t *d, uint32_t old_base, uint32_t new_base, uint32_t max_len);
+int  delta_feed(delta_t *d, const uint8_t *data, int len); //DELTA_MORE, DELTA_OK when END was seen, or an error
+int  delta_finish(delta_t *d);                              //new image length or an error
+
+uint32_t delta_crc32(uint32_t crc, const uint8_t *data, int len);
+
+#endif // __DELTA_H__
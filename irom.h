@@ -0,0 +1,30 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Constants in flash (irom) instead of DRAM
+ *  the ESP8266 reads flash only with aligned 32 bit loads, a byte load traps into a slow exception handler
+ *  so copy a flash string with irom_strcpy before walking it byte by byte (printf formats)
+ *  pointer tables are fine, a pointer is one aligned load
+ */
+#ifndef __IROM_H__
+#define __IROM_H__
+
+#include <stdint.h>
+#include <common_macros.h>
+
+#define IROM_STR(s) ({static IROM char _irom_s[]=s; _irom_s;}) //string literal in flash
+#define IROM_TABLE  __attribute__((section(".irom0.literal"))) //for 'type *const name[]', only the pointers are constant
+
+static inline int irom_strcpy(char *dst, const char *src, int size) { //returns the length, dst is always terminated
+    const uint32_t *w=(const uint32_t*)((uintptr_t)src&~3);
+    int left=4-((uintptr_t)src&3), n=0;
+    uint32_t v=*w++>>(8*(4-left));
+    
+    while (n<size-1) {
+        if (!left) {v=*w++; left=4;}
+        if (!(dst[n]=v)) return n;
+        v>>=8; left--; n++;
+    }
+    dst[n]=0;
+    return n;
+}
+
+#endif // __IROM_H__
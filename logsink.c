@@ -0,0 +1,217 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Non blocking log sink
+ *  The ESP8266 has no compare-and-swap, so a slot is reserved in a critical section of a few instructions.
+ *  The producer then copies its data outside of it and marks the slot ready. The drain task only
+ *  consumes ready slots in order, so a slow producer holds back the drain but never corrupts it.
+ *  With LOG_SERIAL the UART has its own tail and is drained without waiting for an IP, that is when it is
+ *  needed most. Meanwhile UDP keeps only the newest half of the ring so the producers still find room.
+ */
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#ifdef LOG_HOST //tools/logtest provides the UART and the network, tools/posix the tasks
+#include <arpa/inet.h>
+#define STATION_GOT_IP 5
+void uart_putc(int uart, char c);
+int  sdk_wifi_station_get_connect_status(void);
+int  lwip_socket(int domain, int type, int protocol);
+int  lwip_sendto(int s, const void *data, size_t size, int flags, const struct sockaddr *to, socklen_t tolen);
+#else
+#include <esp/uart.h>
+#include <espressif/esp_wifi.h>
+#include <espressif/esp_sta.h>
+#include "lwip/sockets.h"
+#endif
+#include "logsink.h"
+#include "blog.h"
+#include "power.h"
+#include "trace.h"
+
+#define SLOT_WRITING 0
+#define SLOT_READY   1
+#define SLOT_PAD     2 //rest of the ring is unused, continue at the start
+
+typedef struct {
+    uint16_t len;   //of the data that follows
+    uint8_t  kind;
+    uint8_t  state;
+} slot_t;
+#define SLOT_SIZE(len) ((sizeof(slot_t)+(len)+3)&~3)
+
+static const struct {int rate, burst;} limit[LOG_LEVELS]={ //lines per second and bucket size
+    {10, 20}, //error
+    { 5, 40}, //info, a burst for boot and the stats report
+    { 2, 10}, //debug
+};
+
+log_counters_t log_counters[LOG_LEVELS];
+
+static uint32_t ring[LOG_RING/4]; //word aligned
+static volatile uint32_t head=0, tail=0; //free running byte positions, head reserves, tail consumes
+#ifdef LOG_SERIAL
+static volatile uint32_t serial_tail=0;  //the UART consumes separately, it does not wait for the network
+static uint32_t     serial_only=0;       //lines that were not sent by UDP because there was no IP
+#endif
+static int          tokens[LOG_LEVELS]={-1,-1,-1}; //filled on first use
+static TickType_t   refilled;
+static TaskHandle_t drain_handle=NULL;
+
+static uint32_t oldest(void) { //the tail furthest behind, each read once because the drain moves them meanwhile
+#ifdef LOG_SERIAL
+    uint32_t t=tail, s=serial_tail;
+    return head-t>head-s ? t : s;
+#else
+    return tail;
+#endif
+}
+
+static bool take_token(int level, TickType_t now) {
+    int seconds=(now-refilled)*portTICK_PERIOD_MS/1000;
+    if (seconds || tokens[0]<0) {
+        for (int i=0; i<LOG_LEVELS; i++) {
+            tokens[i]=tokens[i]<0 ? limit[i].burst : tokens[i]+seconds*limit[i].rate;
+            if (tokens[i]>limit[i].burst) tokens[i]=limit[i].burst;
+        }
+        refilled+=seconds*1000/portTICK_PERIOD_MS;
+    }
+    if (!tokens[level]) return false;
+    tokens[level]--;
+    return true;
+}
+
+int log_put(int level, int kind, const void *data, int len) {
+    TickType_t now=xTaskGetTickCount();
+    uint32_t   pos, size=SLOT_SIZE(len), need;
+    slot_t     *slot;
+    int        ret=0;
+    
+    if (level<0 || level>=LOG_LEVELS) level=LOG_LEVEL_DEBUG;
+    if (size>LOG_RING/2) return -1;
+    taskENTER_CRITICAL();
+    if (!take_token(level, now)) {
+        log_counters[level].dropped_rate++;
+        ret=-1;
+    } else {
+        pos=head%LOG_RING;
+        need=(pos+size>LOG_RING) ? size+LOG_RING-pos : size;
+        if (head+need-oldest()>LOG_RING) {
+            log_counters[level].dropped_full++;
+            ret=-1;
+        } else {
+            if (need>size) { //wrap around
+                slot=(slot_t*)((uint8_t*)ring+pos);
+                slot->state=SLOT_PAD;
+                pos=0;
+            }
+            slot=(slot_t*)((uint8_t*)ring+pos);
+            slot->state=SLOT_WRITING;
+            slot->len=len;
+            slot->kind=kind;
+            head+=need;
+            log_counters[level].logged++;
+        }
+    }
+    taskEXIT_CRITICAL();
+    if (ret) return ret;
+    
+    memcpy(slot+1, data, len);
+    __asm__ __volatile__("" ::: "memory"); //data must be in place before the slot is marked ready
+    slot->state=SLOT_READY;
+    if (drain_handle) xTaskNotifyGive(drain_handle);
+    return 0;
+}
+
+void log_text(int level, const char *format, ...) {
+    char line[LOG_LINE], fmt[LOG_LINE];
+    va_list args;
+    irom_strcpy(fmt, format, sizeof(fmt));
+    va_start(args, format);
+    int n=vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (n<0) return;
+    if (n>=(int)sizeof(line)) n=sizeof(line)-1; //truncated
+    log_put(level, LOG_TEXT, line, n);
+}
+
+static int sock=-1;
+static uint8_t packet[LOG_PACKET];
+static int packet_len=0, packet_kind=LOG_TEXT;
+
+static void flush(void) {
+    struct sockaddr_in to;
+    if (!packet_len) return;
+    memset(&to, 0, sizeof(to));
+#ifndef LOG_HOST
+    to.sin_len = sizeof(to);
+#endif
+    to.sin_family = AF_INET;
+    to.sin_port = htons(packet_kind==LOG_TEXT ? LOG_PORT : BLOG_PORT);
+    to.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+    if (sock<0) sock=lwip_socket(AF_INET, SOCK_DGRAM, 0);
+    power_tx();
+    TRACE_BEGIN(LOG_FLUSH);
+    if (sock>=0) lwip_sendto(sock, packet, packet_len, 0, (struct sockaddr*)&to, sizeof(to));
+    TRACE_END(LOG_FLUSH);
+    packet_len=0;
+}
+
+static slot_t *next(volatile uint32_t *at) { //the slot at a tail, past any padding, NULL if none is ready
+    uint32_t pos;
+    slot_t   *slot;
+    while (*at!=head) {
+        pos=*at%LOG_RING;
+        slot=(slot_t*)((uint8_t*)ring+pos);
+        if (slot->state!=SLOT_PAD) return slot->state==SLOT_READY ? slot : NULL; //producer still copying
+        *at+=LOG_RING-pos;
+    }
+    return NULL;
+}
+
+static void drain_task(void *argv) {
+    slot_t   *slot;
+    bool     connected=false;
+    
+    while (1) {
+        //producers notify us, only poll while there is no network to send to
+        ulTaskNotifyTake(pdTRUE, connected ? portMAX_DELAY : 100/portTICK_PERIOD_MS);
+#ifdef LOG_SERIAL
+        while ((slot=next(&serial_tail))) {
+            if (slot->kind==LOG_TEXT) for (int i=0; i<slot->len; i++) uart_putc(0, ((char*)(slot+1))[i]);
+            serial_tail+=SLOT_SIZE(slot->len);
+        }
+#endif
+        connected=sdk_wifi_station_get_connect_status()==STATION_GOT_IP;
+        if (!connected) { //the ring holds the lines meanwhile
+#ifdef LOG_SERIAL
+            while (head-tail>LOG_RING/2 && tail!=serial_tail && (slot=next(&tail))) {
+                tail+=SLOT_SIZE(slot->len);
+                serial_only++;
+            }
+#endif
+            continue;
+        }
+        while ((slot=next(&tail))) {
+            if (slot->kind!=packet_kind || packet_len+slot->len>LOG_PACKET) flush();
+            packet_kind=slot->kind;
+            memcpy(packet+packet_len, slot+1, slot->len);
+            packet_len+=slot->len;
+            tail+=SLOT_SIZE(slot->len);
+        }
+        flush();
+    }
+}
+
+void log_report(void) {
+    for (int i=0; i<LOG_LEVELS; i++) LOG_I("log level %d: logged=%u dropped rate=%u full=%u\n",
+            i, log_counters[i].logged, log_counters[i].dropped_rate, log_counters[i].dropped_full);
+#ifdef LOG_SERIAL
+    if (serial_only) LOG_I("log: %u lines only on serial, there was no IP\n", serial_only);
+#endif
+}
+
+void log_init(int priority) {
+    refilled=xTaskGetTickCount();
+    xTaskCreate(drain_task, "LogDrain", LOG_STACK, NULL, priority, &drain_handle);
+}
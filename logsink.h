@@ -0,0 +1,42 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Non blocking log sink
+ *  producers (any task) copy a line or a BLOG record into a static ring and return, they never wait
+ *  a task at idle priority drains the ring to UDP (text on LOG_PORT, binary on BLOG_PORT) and optionally serial
+ *  each level has a token bucket rate limit, lines that do not fit or exceed the rate are counted and dropped
+ *  tools/logtest drives the ring through thousands of wrap-arounds on the host with producer threads and a flaky network
+ */
+#ifndef __LOGSINK_H__
+#define __LOGSINK_H__
+
+#include <stdint.h>
+#include "irom.h"
+
+#define LOG_PORT    45678 //the port of UDPlogger, so its usual listener shows the log
+#define LOG_RING     1536 //bytes, multiple of 4, the hourly report in main.c comes in parts that each fit
+#define LOG_LINE      120 //max chars of a text line
+#define LOG_PACKET    512 //lines and records are combined into packets up to this size
+#define LOG_STACK     384 //words
+
+enum {LOG_LEVEL_ERROR, LOG_LEVEL_INFO, LOG_LEVEL_DEBUG, LOG_LEVELS};
+enum {LOG_TEXT, LOG_BINARY};
+
+typedef struct log_counters {
+    uint32_t logged;
+    uint32_t dropped_rate; //over the rate limit of the level
+    uint32_t dropped_full; //ring was full
+} log_counters_t;
+
+extern log_counters_t log_counters[LOG_LEVELS];
+
+void log_init(int priority);
+int  log_put(int level, int kind, const void *data, int len); //0 if queued
+void log_text(int level, const char *format, ...); //format may be in flash
+void log_report(void);
+
+//formats live in flash, log_check only lets the compiler check the arguments
+static inline void __attribute__((format(printf, 1, 2))) log_check(const char *format, ...) {}
+#define LOG_E(fmt, ...) do {if (0) log_check(fmt, ##__VA_ARGS__); log_text(LOG_LEVEL_ERROR, IROM_STR(fmt), ##__VA_ARGS__);} while(0)
+#define LOG_I(fmt, ...) do {if (0) log_check(fmt, ##__VA_ARGS__); log_text(LOG_LEVEL_INFO,  IROM_STR(fmt), ##__VA_ARGS__);} while(0)
+#define LOG_D(fmt, ...) do {if (0) log_check(fmt, ##__VA_ARGS__); log_text(LOG_LEVEL_DEBUG, IROM_STR(fmt), ##__VA_ARGS__);} while(0)
+
+#endif // __LOGSINK_H__
@@ -40,6 +40,44 @@ for the purpose of ping support */
 #define LWIP_RAW                            1
 #define DEFAULT_RAW_RECVMBOX_SIZE	        5
 
+/*
+LWIP_LEAN: profile sized for this accessory, select with make LWIP_LEAN=1 and compare with tools/lwipsoak
+sockets: HomeKit listener, up to 5 controllers, MQTT, ping and log sink = 9, plus 2 spare for a
+controller that reconnects before its old socket is closed and the ones TRACE, PROFILE and SOAK builds open
+no message is longer than a HomeKit frame (1042 bytes) and the accessories json (~2kB), so a 536 byte MSS
+keeps every response inside one window (4*MSS) while each TCP connection buffers at most
+4*536 instead of 4*1460 bytes in, 2*536 instead of 2*1460 out and one segment out of order.
+we never send or expect IP fragments (log packets are 512 bytes, pings 32) so reassembly is out too.
+the price is about 2.7 times more segments for bulk transfers, only the OTA download does that and it
+is done by the LCM, which has its own lwipopts.h
+*/
+#ifdef LWIP_LEAN
+#ifdef TRACE
+#define LEAN_NETCONN_TRACE              1 //trace.c streams from its own UDP socket
+#else
+#define LEAN_NETCONN_TRACE              0
+#endif
+#ifdef PROFILE
+#define LEAN_NETCONN_PROFILE            1 //profile.c too
+#else
+#define LEAN_NETCONN_PROFILE            0
+#endif
+#ifdef SOAK
+#define LEAN_NETCONN_SOAK               2 //SOAK_NETCONN of soak.h, the bulk listener and its client
+#else
+#define LEAN_NETCONN_SOAK               0
+#endif
+#define MEMP_NUM_NETCONN                (9+2+LEAN_NETCONN_TRACE+LEAN_NETCONN_PROFILE+LEAN_NETCONN_SOAK)
+#define TCP_MSS                         536
+#define TCP_OOSEQ_MAX_BYTES             TCP_MSS
+#define TCP_OOSEQ_MAX_PBUFS             1
+#define LWIP_TCP_SACK_OUT               0
+#define LWIP_TCP_TIMESTAMPS             0
+#define IP_REASSEMBLY                   0
+#define IP_FRAG                         0
+#define DNS_MAX_NAME_LENGTH             64
+#endif
+
 /* end of addition to standard lwipopts.h */
 
 
@@ -5,14 +5,14 @@
  *  GPIO-12 instructs a relay to drive the motor of the pump
  *  GPIO-13 enables the LED to show the state of the pump
  *  GPIO-2 is used as a single one-wire DS18B20 sensor to measure the watersupply temperature
- *  UDPlogger is used to have remote logging
+ *  logsink.c sends the log to UDP port 45678, where the UDPlogger listener shows it
  *  LCM is enabled in case you want remote updates
  */
 
 #include <stdio.h>
 #include <espressif/esp_wifi.h>
 #include <espressif/esp_sta.h>
-//#include <espressif/esp_system.h> //for timestamp report only
+#include <espressif/esp_system.h> //for timestamp report only
 #include <esp/uart.h>
 #include <esp8266.h>
 #include <FreeRTOS.h>
@@ -22,13 +22,32 @@
 #include <string.h>
 #include "lwip/api.h"
 // #include <wifi_config.h>
-#include <udplogger.h>
 #include <adv_button.h>
 #include "ds18b20/ds18b20.h"
+#ifdef ONEWIRE_TIMER
+#include "ow.h"
+#define ds18b20_scan_devices    ow_ds18b20_scan_devices
+#define ds18b20_measure         ow_ds18b20_measure
+#endif
 #include "math.h"
 #include "ping.h"
+#include "power.h"
 #include <rboot-api.h>
 #include "mqtt-client.h"
+#include "scheduler.h"
+#include "control.h"
+#include "stats.h"
+#include "budget.h"
+#include "blog.h"
+#include "logsink.h"
+#include "telemetry.h"
+#include "notify.h"
+#include "report.h"
+#include "trace.h"
+#include "profile.h"
+#include "cpufreq.h"
+#include "sensor.h"
+#include "soak.h"
 #include <sysparam.h>
 
 #ifndef VERSION
@@ -55,18 +74,42 @@
 #endif
 
 int idx; //the domoticz base index
-#define PUBLISH(name) do {int n=mqtt_client_publish("{\"idx\":%d,\"nvalue\":0,\"svalue\":\"%.1f\"}", idx+name##_ix, name##_fv); \
-                            if (n<0) printf("MQTT publish of %s failed because %s\n",#name,MQTT_CLIENT_ERROR(n)); \
-                           } while(0)
-#define tIN_fv  temp[IN]
-#define tIN_ix  0
-#define tOUT_fv temp[OUT]
-#define tOUT_ix 1
-#define tDELTA_fv ((delta5+delta4+delta3+delta2+delta1+delta_out)*16.0) //zoom out by 16 for more detail in MQTT. Samples are 1/16th degree granularity
-#define tDELTA_ix 3
+#define CHANNEL(name, ix, scale, db, min_s, max_s) name,
+enum {
+#include "channels.def"
+    CHANNEL_COUNT
+};
+#undef  CHANNEL
+#define CHANNEL(name, ix, scale, db, min_s, max_s) REPORT_CHANNEL(#name, ix, scale, db, min_s, max_s),
+report_t channels[]={
+#include "channels.def"
+};
+#undef  CHANNEL
+#define REPORT(name, value) report(&channels[name], value)
 char    *pinger_target=NULL;
 
-int inhibit=0; //seconds pump will be inhibited
+TickType_t inhibit_end=0; //tick at which the pump inhibit ends, 0 if not inhibited
+static void inhibit_for(int seconds) {
+    TickType_t end=xTaskGetTickCount()+seconds*1000/portTICK_PERIOD_MS;
+    inhibit_end=end?end:1;
+}
+static int inhibit_left() { //in seconds
+    int left;
+    if (!inhibit_end) return 0;
+    if ((left=(int)(inhibit_end-xTaskGetTickCount()))<=0) inhibit_end=0;
+    return left>0 ? left*portTICK_PERIOD_MS/1000 : 0;
+}
+
+#define BOOT_PHASES 8
+static struct {const char *name; uint32_t us;} boot_phase[BOOT_PHASES];
+static int boot_phases=0;
+#define BOOT_MARK(phase_name) do {if (boot_phases<BOOT_PHASES) { \
+                                    boot_phase[boot_phases].name=phase_name; \
+                                    boot_phase[boot_phases++].us=sdk_system_get_time();} \
+                                 } while(0)
+static void boot_report() {
+    for (int i=0; i<boot_phases; i++) LOG_I("boot %-14s %7u us\n",boot_phase[i].name,boot_phase[i].us);
+}
 
 /* ============== BEGIN HOMEKIT CHARACTERISTIC DECLARATIONS =============================================================== */
 // add this section to make your device OTA capable
@@ -89,22 +132,32 @@ homekit_characteristic_t revision     = HOMEKIT_CHARACTERISTIC_(FIRMWARE_REVISIO
 
 homekit_value_t active_get();
 void active_set(homekit_value_t value);
+void active_off(void *arg);
 homekit_characteristic_t active = HOMEKIT_CHARACTERISTIC_(ACTIVE, 1, .getter=active_get, .setter=active_set);
 homekit_characteristic_t in_use = HOMEKIT_CHARACTERISTIC_(IN_USE, 1                                        );
 
 homekit_characteristic_t cur_temp = HOMEKIT_CHARACTERISTIC_(CURRENT_TEMPERATURE, 1.0                       );
 
 
+#define TEMP_DEADBAND   0.2F //degrees
+#define TEMP_INTERVAL  30000 //ms
+notify_t notifications[]={
+    NOTIFY(cur_temp, TEMP_DEADBAND, TEMP_INTERVAL),
+    NOTIFY(in_use,   0, 0),
+    NOTIFY(active,  -1, 0), //a controller wrote 0 and must see our 1, even if we notified 1 before
+};
+
 homekit_value_t active_get() {
     return HOMEKIT_UINT8(active.value.int_value);
 }
 void active_set(homekit_value_t value) {
     if (value.format != homekit_format_uint8) {
-        UDPLUS("Invalid active-value format: %d\n", value.format);
+        LOG_E("Invalid active-value format: %d\n", value.format);
         return;
     }
-//     UDPLUS("Active:%3d\n",value.int_value);
+//     LOG_I("Active:%3d\n",value.int_value);
     active.value=value;
+    if (!active.value.int_value) sched_post(active_off, NULL);
 }
 
 // void identify_task(void *_args) {
@@ -112,170 +165,307 @@ void active_set(homekit_value_t value) {
 // }
 
 void identify(homekit_value_t _value) {
-    UDPLUS("Identify\n");
+    LOG_I("Identify\n");
 //    xTaskCreate(identify_task, "identify", 256, NULL, 2, NULL);
 }
 
 /* ============== END HOMEKIT CHARACTERISTIC DECLARATIONS ================================================================= */
 
 
-#define BEAT      10 //in seconds
 #define REPEAT 10800 //in seconds = 3 hour
 #define RUN  12*BEAT //in seconds = 2 minutes
 #define STOP_FOR 180 //in seconds = 3 minutes, must be multiple of BEAT
+#define CONVERT  750 //in milliseconds, DS18B20 12 bit conversion time
 #define SENSORS    2
 #define  IN       14 //incoming water temperature
 #define OUT       10 //  return water temperature
-void state_task(void *argv) {
-    bool on=true;
-    bool prev_on=false;
-    int  timer=RUN, prev_on_time=0;
-    int  sampletimer=0;
-    char status[40];
-    float sample_max=0,sample_min=100,delta_out=0;
-    float delta5=0.0, delta4=0.0, delta3=0.0, delta2=0.0, delta1=0.0625;
-    
-    ds18b20_addr_t addrs[SENSORS];
-    float temps[SENSORS],temp[16];
-    int sensor_count=0,id;
-    float old_t;
-
-    while( (sensor_count=ds18b20_scan_devices(SENSOR_PIN, addrs, SENSORS)) != SENSORS) {
-        UDPLUS("Only found %d sensors\n",sensor_count);
-        vTaskDelay(BEAT*1000/portTICK_PERIOD_MS);
+_Static_assert(SENSORS<=SENSOR_MAX, "sensor.c filters SENSOR_MAX sensors");
+void network_task(void *argv);
+void state_job(void *arg);
+void  beat_job(void *arg);
+sched_job_t state=SCHED_JOB(state_job,NULL);
+sched_job_t  beat=SCHED_JOB( beat_job,NULL);
+
+ds18b20_addr_t addrs[SENSORS];
+bool   sensors_found=false, sensors_cached=false;
+
+static void sensors_init() {
+    static bool cache_tried=false;
+    size_t addrs_len=0;
+    bool   is_binary;
+    int    sensor_count;
+
+    //fast path: use the sensor addresses of the previous boot so the first decision does not wait for a bus scan
+    if (!cache_tried && (cache_tried=true) && sysparam_get_data_static("ds18b20_addrs", (uint8_t*)addrs, sizeof(addrs), &addrs_len, &is_binary) \
+        == SYSPARAM_OK && addrs_len==sizeof(addrs)) {
+        sensors_found=sensors_cached=true;
+        return;
     }
+    if ( (sensor_count=ds18b20_scan_devices(SENSOR_PIN, addrs, SENSORS)) != SENSORS) {
+        LOG_I("Only found %d sensors\n",sensor_count);
+        return; //try again next beat
+    }
+    sysparam_set_data("ds18b20_addrs", (uint8_t*)addrs, sizeof(addrs), true);
+    sensors_found=true;
+}
 
-    while(1) {
-        timer-=BEAT;
-        if (timer<=0) {
-            timer=REPEAT;
-            on=false;
-        }
-        ds18b20_measure_and_read_multi(SENSOR_PIN, addrs, SENSORS, temps);
-        for (int j = 0; j < SENSORS; j++) {
-            // The DS18B20 address 64-bit and my batch turns out family C on https://github.com/cpetrich/counterfeit_DS18B20
-            // I have manually selected that I have unique ids using the second hex digit of CRC
-            id = (addrs[j]>>56)&0xF;
-            temp[id] = temps[j];
-//             printf("id=%d %2.4f\n",id,temps[j]);
-        } 
-        if (isnan(temp[OUT])) temp[OUT]=99.99F;
-        if (isnan(temp[IN]))  temp[IN] =99.99F;
-        else { //do not change state if broken input
-            if (temp[IN]>SETPOINT+HYSTERESIS/2) on=true;
-            if (temp[IN]<SETPOINT-HYSTERESIS/2) on=false;
-        }
-        if (on) prev_on_time+=BEAT; else prev_on_time=0;
-        if (prev_on_time>RUN) timer=REPEAT;
-        status[0]=0;
-        if (inhibit) {
-            on=false;
-            sprintf(status," inhibited for another %d seconds",(inhibit/10+1)*10);
-        }
-        if (timer<=RUN) {
-            on=true;
-            strcpy(status," TIMER activated");
-        }
-        
-        //if pump is actived and return temp does not drop by >0.1 degrees in 120s then pump might be broken!
-        if ( !prev_on && on ) {
-            sample_max=sample_min=temp[OUT];
-            sampletimer=RUN+BEAT; //beats during which we are taking samples
-        }
-        if (sampletimer) { //delta is between the MIN and the MAX of the samples, not just the start value
-            if (temp[OUT]<sample_min) sample_min=temp[OUT];
-            if (temp[OUT]>sample_max) sample_max=temp[OUT];
-            sampletimer-=BEAT;
-            if (!sampletimer) { //sampling is done
-                delta_out=sample_max-sample_min;
-                printf("Delta-out= %2.3f\n",delta_out);
-                if (delta_out>1.0) delta_out=1.0; //not interested in bigger values
-                PUBLISH(tDELTA); //report delta_out to MQTT
-                delta5=delta4; delta4=delta3; delta3=delta2; delta2=delta1; delta1=delta_out; 
-            } 
-        }
-        prev_on=on; //store state for next round
-        
-        printf("R%2.3f - %2.3f C => %d%s\n", temp[OUT], temp[IN], on, status);
-        PUBLISH(tIN);
-        PUBLISH(tOUT);
-        gpio_write(RELAY_PIN, on ? 1 : 0);
-        gpio_write(  LED_PIN, on ? 0 : 1);
-        if (on) {
-            old_t=cur_temp.value.float_value;
-            cur_temp.value.float_value=isnan(temp[OUT])?0.0F:(float)(int)(temp[OUT]*10+0.5)/10;
-            if (old_t!=cur_temp.value.float_value) \
-                homekit_characteristic_notify(&cur_temp,HOMEKIT_FLOAT(cur_temp.value.float_value));
+#ifdef LOW_POWER
+#define RADIO_AFTER CONVERT+100 //in milliseconds after the beat, when state_job has queued the publishes of that beat
+static uint32_t last_beat; //in milliseconds
+static int radio_slot(int delay_ms) { //delay_ms rounded up so the job transmits in the same burst as the beat
+    uint32_t now=xTaskGetTickCount()*portTICK_PERIOD_MS, at=last_beat+RADIO_AFTER;
+    while ((int)(at-now)<delay_ms) at+=BEAT*1000;
+    return at-now;
+}
+#else
+#define radio_slot(delay_ms) (delay_ms)
+#endif
+
+void beat_job(void *arg) { //start the conversion and collect the result CONVERT ms later
+#ifdef LOW_POWER
+    last_beat=xTaskGetTickCount()*portTICK_PERIOD_MS;
+#endif
+    if (!sensors_found) sensors_init();
+    if (!sensors_found) return;
+    TRACE_BEGIN(BEAT);
+    ds18b20_measure(SENSOR_PIN, DS18B20_ANY, false);
+    TRACE_END(BEAT);
+    sched_add(&state, CONVERT, 0);
+}
+
+const control_param_t param={SETPOINT,HYSTERESIS,BEAT,REPEAT,RUN};
+control_t    ctrl;
+bool         ctrl_started=false;
+TaskHandle_t publisher=NULL;
+
+static void relay(bool on) {
+    TRACE_BEGIN(RELAY);
+    gpio_write(RELAY_PIN, on ? 1 : 0);
+    gpio_write(  LED_PIN, on ? 0 : 1);
+    TRACE_END(RELAY);
+}
+
+static void telemetry(const char *event) {
+    telemetry_t tel={xTaskGetTickCount()*portTICK_PERIOD_MS, event, ctrl.t_in, ctrl.t_out, ctrl.delta_out, ctrl.delta_sum,
+                     inhibit_left(), ctrl.on, ctrl.inhibited, ctrl.timed, ctrl.delta_ready && !event};
+    if (telemetry_push(&tel) && publisher) xTaskNotifyGive(publisher);
+}
+
+void state_job(void *arg) {
+    static float temp[16];
+    static bool networked=false;
+    float temps[SENSORS];
+    int id;
+
+    TRACE_BEGIN(SENSOR_READ);
+    sensor_read(SENSOR_PIN, addrs, SENSORS, temps); //retries and spike filter, see sensor.h
+    TRACE_END(SENSOR_READ);
+    if (sensors_cached) {
+        sensors_cached=false;
+        if (isnan(temps[0]) && isnan(temps[1])) { //cache is stale, sensors got replaced
+            sensors_found=false;
+            sched_add(&beat, 0, BEAT*1000); //scan right away
+            return;
         }
-        vTaskDelay((BEAT*1000-780)/portTICK_PERIOD_MS);
+        BOOT_MARK("sensors");
+    }
+    for (int j = 0; j < SENSORS; j++) {
+        // The DS18B20 address 64-bit and my batch turns out family C on https://github.com/cpetrich/counterfeit_DS18B20
+        // I have manually selected that I have unique ids using the second hex digit of CRC
+        id = (addrs[j]>>56)&0xF;
+        temp[id] = temps[j];
+//         printf("id=%d %2.4f\n",id,temps[j]);
+    } 
+    if (!ctrl_started) control_init(&ctrl, &param);
+    TRACE_BEGIN(CONTROL);
+    bool on=control_beat(&ctrl, temp[IN], temp[OUT], inhibit_left());
+    TRACE_END(CONTROL);
+    relay(on);
+    ctrl_started=true;
+    telemetry(NULL); //everything else happens in publish_task
+    if (!networked) { //pump is under control, now bring up the network in the background
+        networked=true;
+        BOOT_MARK("first decision");
+        xTaskCreate(network_task, "NetInit", NETINIT_STACK, NULL, 2, NULL);
     }
 }
 
-void inuse_task(void *argv) {
+void control_now(void *arg) { //posted by button and HomeKit events, switches the relay without waiting for the beat
+    if (!ctrl_started) return; //the first beat will pick it up
+    relay(control_apply(&ctrl, inhibit_left()));
+    telemetry((char*)arg);
+}
+
+static char *status(char *buf, const telemetry_t *tel) {
+    buf[0]=0;
+    if (tel->inhibited) sprintf(buf," inhibited for another %d seconds",(tel->inhibit/10+1)*10);
+    if (tel->timed)     strcpy (buf," TIMER activated");
+    return buf;
+}
+
+void publish_task(void *argv) { //fans the telemetry out to the log, MQTT and HomeKit
+    telemetry_t tel;
+    char  buf[40];
+    TickType_t tick=xTaskGetTickCount();
+    
     while (1) {
-        if (!active.value.int_value) {
-            in_use.value.int_value=0;
-            homekit_characteristic_notify(&in_use,HOMEKIT_UINT8(in_use.value.int_value));
-            UDPLUS("In_Use 0 ... waiting 1 second ... In_Use 1\n");
-            vTaskDelay(1000/portTICK_PERIOD_MS);
-            inhibit=STOP_FOR;
-            in_use.value.int_value=1;
-            active.value.int_value=1;
-            homekit_characteristic_notify(&in_use,HOMEKIT_UINT8(in_use.value.int_value));
-            homekit_characteristic_notify(&active,HOMEKIT_UINT8(active.value.int_value));
+        ulTaskNotifyTake(pdTRUE, REPORT_TICK*1000/portTICK_PERIOD_MS);
+        if (xTaskGetTickCount()-tick>=REPORT_TICK*1000/portTICK_PERIOD_MS) { //all reporting stays in this task
+            tick=xTaskGetTickCount();
+            REPORT(tHEAP, (float)stats.heap_free);
+            REPORT(tSTACK,(float)stats.stack_min);
+            REPORT(tHEAPMIN,(float)stats.heap_min);
+            REPORT(tHEAPTOP,(float)stats.heap_top);
+            REPORT(tBUS,  (float)sensor_health());
+            report_heartbeat();
+        }
+        TRACE_BEGIN(PUBLISH);
+        while (telemetry_pop(&tel)) {
+            if (tel.event) {
+                BLOG(EVENT, tel.event, tel.on, status(buf,&tel));
+                continue;
+            }
+            if (tel.delta_ready) {
+                BLOG(DELTA,tel.delta_out);
+                REPORT(tDELTA, tel.delta_sum); //report delta_out to MQTT
+            }
+            BLOG(BEAT, tel.t_out, tel.t_in, tel.on, status(buf,&tel));
+            if (tel.t_in !=CONTROL_NO_TEMP) REPORT(tIN, tel.t_in); //a failed sensor shows in tBUS
+            if (tel.t_out!=CONTROL_NO_TEMP) REPORT(tOUT,tel.t_out);
+            if (tel.on && tel.t_out!=CONTROL_NO_TEMP) {
+                cur_temp.value.float_value=(float)(int)(tel.t_out*10+0.5)/10;
+                notify_changed(&cur_temp);
+            }
         }
-        vTaskDelay(1000/portTICK_PERIOD_MS);
-        if (inhibit) inhibit--;
+        TRACE_END(PUBLISH);
     }
 }
 
-void ping_task(void *argv) {
-    int count=120,delay=1; //seconds
-    ping_result_t res;
-    ip_addr_t to_ping;
-    inet_aton(pinger_target,&to_ping);
-    
-    printf("Pinging IP %s\n", ipaddr_ntoa(&to_ping));
-    while(1){
-        ping_ip(to_ping, &res);
-
-        if (res.result_code == PING_RES_ECHO_REPLY) {
-            count+=10; delay+=5;
-            if (count>120) count=120; if (delay>60) delay=60;
-            printf("good ping from %s %u ms -> count: %d s\n", ipaddr_ntoa(&res.response_ip), res.response_time_ms, count);
-        } else {
-            count--; delay=1;
-            printf("failed ping err %d -> count: %d s\n", res.result_code, count);
-        }
-        if (count==0) {
-            printf("restarting because can't ping home-hub\n");
-            sdk_system_restart();  //#include <rboot-api.h>
+void inuse_job(void *arg) { //one second after Active=0 we return to In_Use 1
+    in_use.value.int_value=1;
+    active.value.int_value=1;
+    notify_changed(&in_use);
+    notify_changed(&active);
+}
+sched_job_t inuse=SCHED_JOB(inuse_job,NULL);
+
+void active_off(void *arg) { //posted by active_set
+    inhibit_for(STOP_FOR);
+    control_now("HomeKit");
+    in_use.value.int_value=0;
+    notify_changed(&in_use);
+    LOG_I("In_Use 0 ... waiting 1 second ... In_Use 1\n");
+    sched_add(&inuse, 1000, 0);
+}
+
+#define PING_POLL 20 //in milliseconds
+void ping_job(void *arg) {
+    static int count=120,delay=1; //seconds
+    static ip_addr_t to_ping;
+    static bool started=false, sent=false;
+    static ping_result_t res;
+
+    TRACE_MARK(PING);
+    if (!started) {
+        started=true;
+        inet_aton(pinger_target,&to_ping);
+        LOG_I("Pinging IP %s\n", ipaddr_ntoa(&to_ping));
+    }
+    if (!sent) {
+        sent=true;
+        if (!ping_start(to_ping, &res)) {
+            sched_add((sched_job_t*)arg, PING_POLL, 0);
+            return;
         }
-        vTaskDelay(delay*(1000/portTICK_PERIOD_MS));
+    } else if (!ping_poll(&res)) { //do not block the scheduler while waiting for the reply
+        sched_add((sched_job_t*)arg, PING_POLL, 0);
+        return;
+    }
+    sent=false;
+
+    if (res.result_code == PING_RES_ECHO_REPLY) {
+        count+=10; delay+=5;
+        if (count>120) count=120; if (delay>60) delay=60;
+        BLOG(PING_GOOD, ipaddr_ntoa(&res.response_ip), res.response_time_ms, count);
+    } else {
+        count--; delay=1;
+        BLOG(PING_FAIL, res.result_code, count);
     }
+    if (count==0) {
+        printf("restarting because can't ping home-hub\n"); //synchronous, we are about to restart
+        sdk_system_restart();  //#include <rboot-api.h>
+    }
+    sched_add((sched_job_t*)arg, radio_slot(delay*1000), 0); //LOW_POWER: 120 failures take up to 20 minutes i.s.o. 2
 }
+sched_job_t pinger=SCHED_JOB(ping_job,&pinger);
+
+#ifndef STATS_PERIOD
+#define STATS_PERIOD    60 //in seconds
+#endif
+#ifndef STATS_REPORT
+#define STATS_REPORT  3600 //in seconds
+#endif
+#define REPORT_GAP    1000 //in milliseconds between the parts of the hourly report, the log drain empties the ring
+static int report_part;
+void report_job(void *arg) { //one part per run, each one fits LOG_RING, which the whole report does not
+    if (report_part<STATS_PARTS) stats_report(report_part);
+    else switch (report_part-STATS_PARTS) {
+        case 0:
+            log_report();
+            LOG_I("HomeKit notifications sent=%u suppressed=%u\n", notify_sent, notify_suppressed);
+            break;
+        case 1:
+            report_stats();
+            break;
+        default:
+            power_report();
+            cpufreq_report();
+            sensor_report();
+#ifdef ONEWIRE_TIMER
+            ow_report();
+#endif
+            return;
+    }
+    report_part++;
+    sched_add((sched_job_t*)arg, REPORT_GAP, 0);
+}
+sched_job_t reporter=SCHED_JOB(report_job,&reporter);
+
+void stats_job(void *arg) {
+    static int seconds=0;
+    stats_sample(); //published by publish_task
+    if ((seconds+=STATS_PERIOD)>=STATS_REPORT) {
+        seconds=0;
+        report_part=0;
+        sched_add(&reporter, 0, 0);
+    }
+}
+sched_job_t stats_sampler=SCHED_JOB(stats_job,NULL);
 
 void singlepress_callback(uint8_t gpio, void *args) {
-            UDPLUS("single press = inhibit 15 minutes\n");
-            inhibit=900;
+            LOG_I("single press = inhibit 15 minutes\n");
+            inhibit_for(900);
+            sched_post(control_now, "single press");
 }
 
 void doublepress_callback(uint8_t gpio, void *args) {
-            UDPLUS("double press = inhibit 1 hour\n");
-            inhibit=3600;
+            LOG_I("double press = inhibit 1 hour\n");
+            inhibit_for(3600);
+            sched_post(control_now, "double press");
 }
 
 void longpress_callback(uint8_t gpio, void *args) {
-            UDPLUS("long press = stop inhibit\n");
-            inhibit=5;
+            LOG_I("long press = stop inhibit\n");
+            inhibit_for(5);
+            sched_post(control_now, "long press");
 }
 
 mqtt_config_t mqttconf=MQTT_DEFAULT_CONFIG;
 char error[]="error";
 static void ota_string() {
+    static char otas[OTA_STRING_LEN]; //strtok results point into it
     char *dmtczbaseidx1=NULL;
-    char *otas;
-    if (sysparam_get_string("ota_string", &otas) == SYSPARAM_OK) {
+    if (!ota_sysparam_string("ota_string", otas, sizeof(otas))) {
         mqttconf.host=strtok(otas,";");
         mqttconf.user=strtok(NULL,";");
         mqttconf.pass=strtok(NULL,";");
@@ -299,68 +489,114 @@ void device_init() {
     gpio_enable( RELAY_PIN, GPIO_OUTPUT); gpio_write( RELAY_PIN, 1);
     gpio_set_pullup(SENSOR_PIN, true, true);
 
-    //sysparam_set_string("ota_string", "192.168.178.5;pumpswitch;fakepassword;89;192.168.178.100"); //can be used if not using LCM
-    ota_string();
-    mqttconf.queue_size=6;
-    mqtt_client_init(&mqttconf);
-
-    xTaskCreate(state_task, "State", 512, NULL, 1, NULL);
-    xTaskCreate(inuse_task, "InUse", 512, NULL, 1, NULL);
-    xTaskCreate( ping_task, "PingT", 512, NULL, 1, NULL);
+    xTaskCreate(publish_task, "Publish", PUBLISH_STACK, NULL, 1, &publisher);
+    sched_init(SCHED_STACK, 2);
+    sched_add(&beat, 0, BEAT*1000);
 }
 
-homekit_accessory_t *accessories[] = {
+//the service and characteristic lists live in flash, only the structs homekit writes to stay in RAM
+//the names and the password stay in RAM too, homekit walks them byte by byte (json, setup)
+static char name_accessory[]="pumpswitch";
+static char name_pump[]     ="Pump";
+static char name_temp[]     ="ReturnTemp";
+static char password[]      ="111-11-111";
+
+static homekit_characteristic_t *const info_characteristics[] IROM_TABLE={
+    HOMEKIT_CHARACTERISTIC(NAME, name_accessory),
+    &manufacturer,
+    &serial,
+    &model,
+    &revision,
+    HOMEKIT_CHARACTERISTIC(IDENTIFY, identify),
+    NULL
+};
+static homekit_characteristic_t *const valve_characteristics[] IROM_TABLE={
+    HOMEKIT_CHARACTERISTIC(NAME, name_pump),
+    &active,
+    &in_use,
+    HOMEKIT_CHARACTERISTIC(VALVE_TYPE, 0),
+    &ota_trigger,
+    NULL
+};
+static homekit_characteristic_t *const temp_characteristics[] IROM_TABLE={
+    HOMEKIT_CHARACTERISTIC(NAME, name_temp),
+    &cur_temp,
+    NULL
+};
+static homekit_service_t *const services[] IROM_TABLE={
+    HOMEKIT_SERVICE(ACCESSORY_INFORMATION, .characteristics=(homekit_characteristic_t**)info_characteristics),
+    HOMEKIT_SERVICE(VALVE, .primary=true,  .characteristics=(homekit_characteristic_t**)valve_characteristics),
+    HOMEKIT_SERVICE(TEMPERATURE_SENSOR,    .characteristics=(homekit_characteristic_t**)temp_characteristics),
+    NULL
+};
+static homekit_accessory_t *const accessories[] IROM_TABLE={
     HOMEKIT_ACCESSORY(
         .id=1,
         .category=homekit_accessory_category_other,
-        .services=(homekit_service_t*[]){
-            HOMEKIT_SERVICE(ACCESSORY_INFORMATION,
-                .characteristics=(homekit_characteristic_t*[]){
-                    HOMEKIT_CHARACTERISTIC(NAME, "pumpswitch"),
-                    &manufacturer,
-                    &serial,
-                    &model,
-                    &revision,
-                    HOMEKIT_CHARACTERISTIC(IDENTIFY, identify),
-                    NULL
-                }),
-            HOMEKIT_SERVICE(VALVE, .primary=true,
-                .characteristics=(homekit_characteristic_t*[]){
-                    HOMEKIT_CHARACTERISTIC(NAME, "Pump"),
-                    &active,
-                    &in_use,
-                    HOMEKIT_CHARACTERISTIC(VALVE_TYPE, 0),
-                    &ota_trigger,
-                    NULL
-                }),
-            HOMEKIT_SERVICE(TEMPERATURE_SENSOR,
-                .characteristics=(homekit_characteristic_t*[]){
-                    HOMEKIT_CHARACTERISTIC(NAME, "ReturnTemp"),
-                    &cur_temp,
-                    NULL
-                }),
-            NULL
-        }),
+        .services=(homekit_service_t**)services),
     NULL
 };
 
+//pair-setup and pair-verify run at 160 MHz, see cpufreq.h, one hold per connected client until it is verified
+//the events do not say which client, so a disconnect releases nothing: it may be a verified client while another
+//is still in pair-verify; a client that leaves before it is verified is dropped at the limit of cpufreq.c
+static void on_event(homekit_event_t event) {
+    switch (event) {
+        case HOMEKIT_EVENT_CLIENT_CONNECTED:    cpufreq_hold(CPUFREQ_HOMEKIT);    break;
+        case HOMEKIT_EVENT_CLIENT_VERIFIED:
+        case HOMEKIT_EVENT_PAIRING_ADDED:       cpufreq_release(CPUFREQ_HOMEKIT); break;
+        default: break;
+    }
+}
+
 homekit_server_config_t config = {
-    .accessories = accessories,
-    .password = "111-11-111"
+    .accessories = (homekit_accessory_t**)accessories,
+    .password = password,
+    .on_event = on_event
 };
 
 
-void user_init(void) {
-    uart_set_baud(0, 115200);
-    udplog_init(3);
-    UDPLUS("\n\n\nPumpSwitch " VERSION "\n");
-
-    device_init();
+void network_task(void *argv) { //started by state_job once the first relay decision is made
+    //sysparam_set_string("ota_string", "192.168.178.5;pumpswitch;fakepassword;89;192.168.178.100"); //can be used if not using LCM
+    ota_string();
+    mqttconf.queue_size=MQTT_QUEUE_SIZE;
+#ifdef LOW_POWER
+    mqttconf.keepalive=3*BEAT; //the mqtt task wakes every beat to publish anyway, so its pings ride along
+    power_init(LOW_POWER);
+#else
+    power_init(0);
+#endif
+    mqtt_client_init(&mqttconf);
+    report_init(channels, CHANNEL_COUNT, idx);
+    trace_init();
+    profile_init();
+    sched_add(&pinger, 0, 0);
+    sched_add(&stats_sampler, radio_slot(STATS_PERIOD*1000), STATS_PERIOD*1000);
+    BOOT_MARK("mqtt");
     
     int c_hash=ota_read_sysparam(&manufacturer.value.string_value,&serial.value.string_value,
                                       &model.value.string_value,&revision.value.string_value);
     //c_hash=2; revision.value.string_value="0.0.2"; //cheat line
     config.accessories[0]->config_number=c_hash;
+    BOOT_MARK("sysparam");
     
+    notify_init(notifications, sizeof(notifications)/sizeof(notifications[0]));
     homekit_server_init(&config);
+    BOOT_MARK("homekit");
+    soak_init(1);
+    boot_report();
+    LOG_I("budget static=%d init=%d of %d bytes\n",(int)BUDGET_STATIC,(int)BUDGET_INIT,BUDGET_MAX);
+    vTaskDelete(NULL);
+}
+
+void user_init(void) {
+    BOOT_MARK("user_init");
+    uart_set_baud(0, 115200);
+    log_init(0);
+    cpufreq_init();
+    LOG_I("\n\n\nPumpSwitch " VERSION "\n");
+    BOOT_MARK("log_init");
+
+    device_init();
+    BOOT_MARK("device_init");
 }
@@ -10,9 +10,14 @@
 #include <paho_mqtt_c/MQTTClient.h>
 #include <semphr.h>
 #include "mqtt-client.h"
+#include "logsink.h"
+#include "power.h"
+#include "trace.h"
 
 QueueHandle_t publish_queue;
 mqtt_config_t *mqttconf;
+static char    msg[MQTT_MSG_LEN]; //only used by mqtt_task
+static uint8_t mqtt_buf[MQTT_BUF_LEN];
 
 static const char *  get_my_id(void) {
     // Use MAC address for Station as unique ID
@@ -46,13 +51,6 @@ static void  mqtt_task(void *pvParameters) {
     char mqtt_client_id[20];
     uint8_t mqtt_readbuf[4]; //we do not intend to use this, but a minimum might be needed?? guessing 4
     mqtt_packet_connect_data_t data = mqtt_packet_connect_data_initializer;
-    char msg[mqttconf->msg_len];
-    int  mqtt_buf_len;
-    
-    ret=20+sizeof(mqtt_client_id)+strlen(mqttconf->user)+strlen(mqttconf->pass);
-    mqtt_buf_len=8+strlen(mqttconf->topic)+mqttconf->msg_len;
-    if (mqtt_buf_len<ret) mqtt_buf_len=ret;
-    uint8_t *mqtt_buf=malloc(mqtt_buf_len);
 
     mqtt_network_new( &network );
     memset(mqtt_client_id, 0, sizeof(mqtt_client_id));
@@ -64,36 +62,38 @@ static void  mqtt_task(void *pvParameters) {
     data.clientID.cstring   = mqtt_client_id;
     data.username.cstring   = mqttconf->user;
     data.password.cstring   = mqttconf->pass;
-    data.keepAliveInterval  = 10;
+    data.keepAliveInterval  = mqttconf->keepalive;
     data.cleansession       = 0;
 
-    printf("%s: started\n", __func__);
+    LOG_I("%s: started\n", __func__);
     while(1) {
         while (sdk_wifi_station_get_connect_status() != STATION_GOT_IP) vTaskDelay(200/portTICK_PERIOD_MS); //Check if we have an IP
-        printf("%s: (re)connecting to MQTT server %s ... ",__func__, mqttconf->host);
+        LOG_I("%s: (re)connecting to MQTT server %s ... ",__func__, mqttconf->host);
         ret = mqtt_network_connect(&network, mqttconf->host, mqttconf->port);
         if( ret ){
-            printf("error: %d\n", ret);
+            LOG_E("error: %d\n", ret);
             vTaskDelay(backoff);
             if (backoff<BACKOFF1*128) backoff*=2; //max out at 12.8 seconds
             continue;
         }
-        printf("done\n");
-        mqtt_client_new(&client, &network, 5000, mqtt_buf, mqtt_buf_len, mqtt_readbuf, 4);
-        printf("%s: send MQTT connect ... ", __func__);
+        LOG_I("done\n");
+        mqtt_client_new(&client, &network, 5000, mqtt_buf, MQTT_BUF_LEN, mqtt_readbuf, 4);
+        LOG_I("%s: send MQTT connect ... ", __func__);
         ret = mqtt_connect(&client, &data);
         if(ret){
-            printf("error: %d\n", ret);
+            LOG_E("error: %d\n", ret);
             mqtt_network_disconnect(&network);
             vTaskDelay(backoff);
             if (backoff<BACKOFF1*128) backoff*=2; //max out at 12.8 seconds
             continue;
         }
-        printf("done\n");
+        LOG_I("done\n");
         backoff = BACKOFF1;
 
         while(1) {
             msg[mqttconf->msg_len - 1] = 0;
+            //sleep until something is published, those come at the beat, or a keepalive check is due
+            xQueuePeek(publish_queue, (void *)msg, mqttconf->keepalive*1000/3/portTICK_PERIOD_MS);
             while(xQueueReceive(publish_queue, (void *)msg, 0) == pdTRUE){
                 mqtt_message_t message;
                 message.payload = msg;
@@ -101,22 +101,28 @@ static void  mqtt_task(void *pvParameters) {
                 message.dup = 0;
                 message.qos = MQTT_QOS1;
                 message.retained = 0;
+                power_tx();
+                TRACE_BEGIN(MQTT_SEND);
                 ret = mqtt_publish(&client, mqttconf->topic , &message);
+                TRACE_END(MQTT_SEND);
                 if (ret != MQTT_SUCCESS ){
-                    printf("%s: error while publishing message: %d\n", __func__, ret );
+                    LOG_E("%s: error while publishing message: %d\n", __func__, ret );
                     break;
                 }
             }
-            ret = mqtt_yield(&client, 1000);
+            TRACE_BEGIN(MQTT_YIELD);
+            ret = mqtt_yield(&client, 10); //sends the keepalive ping if due and reads the answers
+            TRACE_END(MQTT_YIELD);
             if (ret == MQTT_DISCONNECTED) break;
         }
-        printf("%s: connection dropped, connecting again\n", __func__);
+        LOG_E("%s: connection dropped, connecting again\n", __func__);
         mqtt_network_disconnect(&network);
         xQueueReset(publish_queue);
     }
 }
 
 int mqtt_client_publish(char *format, ...) {
+    if (!publish_queue) return -3; //mqtt_client_init not called yet
     char msg[mqttconf->msg_len];
     va_list args;
     va_start(args, format);
@@ -128,7 +134,16 @@ int mqtt_client_publish(char *format, ...) {
 }
 
 void mqtt_client_init(mqtt_config_t *config) {
+    int connect_len, publish_len;
     mqttconf=config;
+    if (mqttconf->msg_len>MQTT_MSG_LEN) mqttconf->msg_len=MQTT_MSG_LEN;
+    connect_len=20+20+strlen(mqttconf->user)+strlen(mqttconf->pass); //client id is 20
+    publish_len=8+strlen(mqttconf->topic)+mqttconf->msg_len;
+    if (connect_len>MQTT_BUF_LEN || publish_len>MQTT_BUF_LEN) { //the connect would fail forever, so do not start
+        LOG_E("%s: MQTT_BUF_LEN=%d but %d needed, MQTT not started\n", __func__, MQTT_BUF_LEN,
+                connect_len>publish_len ? connect_len : publish_len);
+        return; //mqtt_client_publish returns -3
+    }
     publish_queue = xQueueCreate(mqttconf->queue_size, mqttconf->msg_len);
-    xTaskCreate(&mqtt_task, "mqtt_task", 1024, NULL, 2, NULL);
+    xTaskCreate(&mqtt_task, "mqtt_task", MQTT_STACK, NULL, 2, NULL);
 }
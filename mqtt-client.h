@@ -9,6 +9,15 @@
 #ifndef __MQTT_CLIENT_H__
 #define __MQTT_CLIENT_H__
 
+#ifndef MQTT_MSG_LEN
+#define MQTT_MSG_LEN   64 //max msg_len, buffers are static
+#endif
+#ifndef MQTT_BUF_LEN
+#define MQTT_BUF_LEN  160 //must fit the connect packet with user and pass, and a publish packet
+#endif
+#define MQTT_STACK    1024 //words
+#define MQTT_QUEUE_SIZE  6 //messages, set as queue_size by main.c
+
 typedef struct mqtt_config {
     int  dummy; //somehow the first entry is treated as a stray pointer so this is a workaround
     int  queue_size;
@@ -18,9 +27,10 @@ typedef struct mqtt_config {
     char *user;
     char *pass;
     char *topic;
+    int  keepalive; //seconds, the task sleeps on the queue for a third of it between keepalive checks
 } mqtt_config_t;
-#define MQTT_DEFAULT_CONFIG {0,3,48,NULL,1883,NULL,NULL,"domoticz/in"}
-#define MQTT_CLIENT_ERROR(ret)    (ret==-1?"queue full":"message too long")
+#define MQTT_DEFAULT_CONFIG {0,3,48,NULL,1883,NULL,NULL,"domoticz/in",10}
+#define MQTT_CLIENT_ERROR(ret)    (ret==-1?"queue full":ret==-2?"message too long":"not started")
 
 void mqtt_client_init(mqtt_config_t *config);
 int  mqtt_client_publish(char *format,  ...);
@@ -0,0 +1,80 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Coalescing of HomeKit notifications, the flush runs as a scheduler job
+ */
+#include <math.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include "scheduler.h"
+#include "notify.h"
+#include "trace.h"
+
+uint32_t notify_sent=0, notify_suppressed=0;
+
+static notify_t *table;
+static int      count=0;
+static volatile bool window=false; //a flush at the end of the coalescing window is scheduled
+
+static void flush_job(void *arg);
+static sched_job_t flush=SCHED_JOB(flush_job,NULL);
+
+static bool same(homekit_value_t a, homekit_value_t b, float deadband) {
+    if (deadband<0) return false;
+    switch (a.format) {
+        case homekit_format_float: return fabsf(a.float_value-b.float_value)<deadband || a.float_value==b.float_value;
+        case homekit_format_bool:  return a.bool_value==b.bool_value;
+        default:                   return a.int_value==b.int_value;
+    }
+}
+
+static void flush_job(void *arg) {
+    uint32_t now=xTaskGetTickCount()*portTICK_PERIOD_MS, wait=0;
+    homekit_value_t value;
+    
+    window=false;
+    for (int i=0; i<count; i++) {
+        notify_t *n=table+i;
+        if (!n->dirty) continue;
+        if (n->last && now-n->last<n->min_interval) { //too soon, try again when the interval is over
+            if (!wait || n->min_interval-(now-n->last)<wait) wait=n->min_interval-(now-n->last);
+            continue;
+        }
+        n->dirty=false; //before reading the value, so a change from now on marks it again
+        value=n->ch->value;
+        if (same(value, n->sent, n->deadband)) {
+            notify_suppressed++;
+            continue;
+        }
+        TRACE_BEGIN(HK_NOTIFY);
+        homekit_characteristic_notify(n->ch, value);
+        TRACE_END(HK_NOTIFY);
+        n->sent=value;
+        n->last=now?now:1;
+        notify_sent++;
+    }
+    if (wait) sched_add(&flush, wait, 0); //a change before that moves the flush forward to its window
+}
+
+void notify_changed(homekit_characteristic_t *ch) {
+    bool start;
+    for (int i=0; i<count; i++) if (table[i].ch==ch) {
+        table[i].dirty=true;
+        taskENTER_CRITICAL(); //the HomeKit and the scheduler task both get here
+        start=!window;
+        window=true;
+        taskEXIT_CRITICAL();
+        if (start && sched_add(&flush, NOTIFY_WINDOW, 0)) { //scheduler queue full, no window this time
+            window=false;
+            table[i].dirty=false;
+            homekit_characteristic_notify(ch, ch->value);
+            notify_sent++;
+        }
+        return;
+    }
+    homekit_characteristic_notify(ch, ch->value); //not in the table, no coalescing
+}
+
+void notify_init(notify_t *notify_table, int notify_count) {
+    table=notify_table;
+    count=notify_count;
+    for (int i=0; i<count; i++) table[i].sent=table[i].ch->value; //controllers read the initial value
+}
@@ -0,0 +1,32 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Coalescing of HomeKit notifications
+ *  update the value of a characteristic and call notify_changed instead of homekit_characteristic_notify
+ *  after NOTIFY_WINDOW all changed characteristics are notified back to back, so the server sends
+ *  them to each controller in one event message
+ *  per characteristic a deadband (float only) and a minimum interval between notifications apply
+ */
+#ifndef __NOTIFY_H__
+#define __NOTIFY_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <homekit/homekit.h>
+
+#define NOTIFY_WINDOW 100 //ms
+
+typedef struct notify {
+    homekit_characteristic_t *ch;
+    float    deadband;     //a float value must move at least this much from the last notified value, <0 always notify
+    uint32_t min_interval; //ms between two notifications
+    homekit_value_t sent;  //last notified value
+    uint32_t last;         //ms of last notification
+    volatile bool dirty;
+} notify_t;
+#define NOTIFY(characteristic, deadband, min_interval_ms) {&characteristic, deadband, min_interval_ms}
+
+extern uint32_t notify_sent, notify_suppressed;
+
+void notify_init(notify_t *table, int count);
+void notify_changed(homekit_characteristic_t *ch);
+
+#endif // __NOTIFY_H__
@@ -1,4 +1,4 @@
-#include <stdlib.h>  //for printf
+#include <stdlib.h>  //for atoi
 #include <stdio.h>
 #include <string.h>
 
@@ -6,6 +6,9 @@
 #include <espressif/esp_sta.h>
 #include <rboot-api.h>
 #include <sysparam.h>
+#include <homekit/types.h>
+#include "ota-api.h"
+#include "logsink.h"
 
 // the first function is the ONLY thing needed for a repo to support ota after having started with ota-boot
 // in ota-boot the user gets to set the wifi and the repository details and it then installs the ota-main binary
@@ -16,28 +19,33 @@ void ota_update(void *arg) {  //arg not used
     // there is a bug in the esp SDK such that if you do not power cycle the chip after serial flashing, restart is unreliable
 }
 
+int ota_sysparam_string(const char *key, char *buf, size_t size) {
+    size_t len;
+    bool   is_binary;
+    if (sysparam_get_data_static(key, (uint8_t*)buf, size-1, &len, &is_binary) != SYSPARAM_OK || len>size-1) return -1;
+    buf[len]=0;
+    return 0;
+}
+
 // this function is optional to couple Homekit parameters to the sysparam variables and github parameters
 unsigned int  ota_read_sysparam(char **manufacturer,char **serial,char **model,char **revision) {
-    sysparam_status_t status;
-    char *value;
+    static char repo[OTA_REPO_LEN], version_value[OTA_VERSION_LEN], serial_value[OTA_SERIAL_LEN];
 
-    status = sysparam_get_string("ota_repo", &value);
-    if (status == SYSPARAM_OK) {
-        strchr(value,'/')[0]=0;
-        *manufacturer=value;
-        *model=value+strlen(value)+1;
+    if (!ota_sysparam_string("ota_repo", repo, sizeof(repo)) && strchr(repo,'/')) {
+        strchr(repo,'/')[0]=0;
+        *manufacturer=repo;
+        *model=repo+strlen(repo)+1;
     } else {
         *manufacturer="manuf_unknown";
         *model="model_unknown";
     }
-    status = sysparam_get_string("ota_version", &value);
-    if (status == SYSPARAM_OK) {
-        *revision=value;
+    if (!ota_sysparam_string("ota_version", version_value, sizeof(version_value))) {
+        *revision=version_value;
     } else *revision="0.0.0";
 
     uint8_t macaddr[6];
     sdk_wifi_get_macaddr(STATION_IF, macaddr);
-    *serial=malloc(18);
+    *serial=serial_value;
     sprintf(*serial,"%02X:%02X:%02X:%02X:%02X:%02X",macaddr[0], macaddr[1], macaddr[2], macaddr[3], macaddr[4], macaddr[5]);
 
     unsigned int c_hash=0;
@@ -49,7 +57,7 @@ unsigned int  ota_read_sysparam(char **manufacturer,char **serial,char **model,c
     if ((dot=strchr(rev,'.'))) {dot[0]=0; c_hash=c_hash*1000+atoi(rev); rev=dot+1;}
                                           c_hash=c_hash*1000+atoi(rev);
                                             //c_hash=c_hash*10  +configuration_variant; //possible future extension
-    printf("manuf=\'%s\' serial=\'%s\' model=\'%s\' revision=\'%s\' c#=%d\n",*manufacturer,*serial,*model,*revision,c_hash);
+    LOG_I("manuf=\'%s\' serial=\'%s\' model=\'%s\' revision=\'%s\' c#=%d\n",*manufacturer,*serial,*model,*revision,c_hash);
     return c_hash;
 }
 
@@ -64,7 +72,7 @@ static ETSTimer update_timer;
 
 void ota_set(homekit_value_t value) {
     if (value.format != homekit_format_bool) {
-        printf("Invalid ota-value format: %d\n", value.format);
+        LOG_E("Invalid ota-value format: %d\n", value.format);
         return;
     }
     if (value.bool_value) {
@@ -16,6 +16,13 @@
     .value = HOMEKIT_BOOL_(_value), \
     ##__VA_ARGS__
 
+#define OTA_REPO_LEN     64 //static buffers for the sysparam strings
+#define OTA_VERSION_LEN  16
+#define OTA_SERIAL_LEN   18
+#define OTA_STRING_LEN  128
+
+int  ota_sysparam_string(const char *key, char *buf, size_t size); //into a static buffer, 0 if ok
+
 unsigned int  ota_read_sysparam(char **manufacturer,char **serial,char **model,char **revision);
 
 void ota_update(void *arg);
@@ -0,0 +1,300 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Timer driven 1-Wire master, see ow.h
+ */
+#include <string.h>
+#include <math.h>
+#include "ow.h"
+
+#ifdef OW_HOST //tools/owemu provides the bus, the timer and the waiting
+#define IRAM
+#define OW_CYCLES_PER_US 1
+void ow_hal_init(int pin);
+void ow_hal_low(void);
+void ow_hal_release(void);
+bool ow_hal_read(void);
+void ow_hal_delay(uint32_t us);
+void ow_hal_arm(uint32_t us);
+void ow_hal_done(void);
+void ow_hal_stop(void);
+bool ow_hal_wait(void);
+void ow_hal_sleep(int ms);
+uint32_t ow_hal_cycles(void);
+#define cpufreq_pin()
+#define cpufreq_unpin()
+#else
+#include <FreeRTOS.h>
+#include <task.h>
+#include <esp8266.h>
+#include <espressif/esp_misc.h>
+#include <espressif/esp_system.h>
+#include <xtensa_ops.h>
+#include "logsink.h"
+#include "cpufreq.h"
+#define OW_CYCLES_PER_US sdk_system_get_cpu_freq() //taken per transaction, cpufreq is pinned meanwhile
+
+static int ow_pin;
+static TaskHandle_t waiter;
+static void ow_isr(void *arg);
+
+static inline void ow_hal_low(void)     {gpio_write(ow_pin, 0);}
+static inline void ow_hal_release(void) {gpio_write(ow_pin, 1);} //open drain, the pull-up takes the line high
+static inline bool ow_hal_read(void)    {return gpio_read(ow_pin);}
+static inline void ow_hal_delay(uint32_t us) {sdk_os_delay_us(us);}
+static inline void ow_hal_arm(uint32_t us) {timer_set_load(FRC1, us*5); timer_set_run(FRC1, true);} //80 MHz / 16
+static inline uint32_t ow_hal_cycles(void) {uint32_t c; RSR(c, ccount); return c;}
+static void ow_hal_sleep(int ms) {vTaskDelay(ms/portTICK_PERIOD_MS);}
+
+static void ow_hal_init(int pin) {
+    ow_pin=pin;
+    gpio_enable(pin, GPIO_OUT_OPEN_DRAIN);
+    gpio_write(pin, 1);
+    _xt_isr_attach(INUM_TIMER_FRC1, ow_isr, NULL);
+    timer_set_divider(FRC1, TIMER_CLKDIV_16);
+    timer_set_reload(FRC1, false);
+    timer_set_interrupts(FRC1, true);
+}
+
+static void ow_hal_stop(void) {
+    timer_set_run(FRC1, false);
+    gpio_write(ow_pin, 1);
+}
+
+static bool ow_hal_wait(void) {
+    return ulTaskNotifyTake(pdTRUE, OW_TIMEOUT/portTICK_PERIOD_MS)>0;
+}
+
+static void IRAM ow_hal_done(void) {
+    BaseType_t woken=pdFALSE;
+    timer_set_run(FRC1, false);
+    vTaskNotifyGiveFromISR(waiter, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+#endif
+
+enum {ST_IDLE, ST_RESET, ST_PRESENCE, ST_WRITE0, ST_SLOT};
+
+ow_stats_t ow_stats;
+static bool ready=false;
+
+static struct { //the transaction the interrupt works on
+    const uint8_t *tx;
+    uint8_t  *rx;
+    int      tx_bits, rx_bits, bit; //bit counts through tx and then rx or the ROM
+    bool     search, id, dir;       //ROM search: first read of a triplet and the direction taken
+    int      step, last, last_zero; //triplet step, discrepancy taken last pass and the last one where 0 was taken
+    uint64_t rom;
+    uint32_t release, mhz;          //cycle count when the reset pulse ended, cycles per us
+    int      state, late;
+    volatile int result;
+} t;
+
+static void IRAM finish(int result) {
+    t.state=ST_IDLE;
+    t.result=result;
+    if (result) ow_stats.errors++;
+    ow_hal_done();
+}
+
+static void IRAM got(bool v) { //result of a read slot
+    int n=t.bit-t.tx_bits;
+    if (!t.search) {
+        if (v) t.rx[n/8]|=1<<(n%8);
+        t.bit++;
+        return;
+    }
+    if (t.step==0) {t.id=v; t.step=1; return;}
+    if (t.id && v) {finish(OW_ERR_SEARCH); return;} //nobody left on the bus
+    if (t.id!=v) t.dir=t.id; //all remaining devices agree
+    else {
+        t.dir=n<t.last ? (t.rom>>n)&1 : n==t.last;
+        if (!t.dir) t.last_zero=n;
+    }
+    t.step=2;
+}
+
+static void IRAM slot(void) { //start the next bit slot, the previous one and its recovery time are over
+    int  n=t.bit-t.tx_bits;
+    bool v;
+    if (t.bit<t.tx_bits) {
+        v=(t.tx[t.bit/8]>>(t.bit%8))&1;
+        t.bit++;
+    } else if (n>=(t.search ? 64 : t.rx_bits)) {
+        finish(OW_OK);
+        return;
+    } else if (t.search && t.step==2) {
+        v=t.dir;
+        if (v) t.rom|=1ULL<<n; else t.rom&=~(1ULL<<n);
+        t.step=0; t.bit++;
+    } else { //read: release after 2 us and sample before the 15 us in which a device holds a 0
+        ow_stats.slots++;
+        ow_hal_low(); ow_hal_delay(2); ow_hal_release(); ow_hal_delay(11);
+        got(ow_hal_read());
+        if (t.state==ST_SLOT) ow_hal_arm(52);
+        return;
+    }
+    ow_stats.slots++;
+    if (v) {
+        ow_hal_low(); ow_hal_delay(6); ow_hal_release();
+        ow_hal_arm(64);
+    } else { //the 60 us low phase is timed by the next interrupt, nothing to spin for
+        ow_hal_low();
+        t.state=ST_WRITE0;
+        ow_hal_arm(60);
+    }
+}
+
+static void IRAM ow_isr(void *arg) { //FRC1, one step of the transaction
+    uint32_t start=ow_hal_cycles(), run;
+    switch (t.state) {
+        case ST_RESET: //480 us low are over, devices answer within 60 us for at least 60 us
+            ow_hal_release();
+            t.release=ow_hal_cycles();
+            t.state=ST_PRESENCE;
+            ow_hal_arm(62);
+            break;
+        case ST_PRESENCE: { //only 60 to 75 us after the release is safe for every device
+            uint32_t us=(ow_hal_cycles()-t.release)/t.mhz;
+            if (us>75) { //another interrupt held us up, reset again
+                ow_stats.late++;
+                if (++t.late>OW_RETRIES) {finish(OW_ERR_LATE); break;}
+                ow_hal_low();
+                t.state=ST_RESET;
+                ow_hal_arm(480);
+                break;
+            }
+            if (us<60) ow_hal_delay(60-us);
+            if (ow_hal_read()) {finish(OW_ERR_PRESENCE); break;}
+            t.state=ST_SLOT;
+            ow_hal_arm(410);
+            break;
+        }
+        case ST_WRITE0:
+            ow_hal_release();
+            t.state=ST_SLOT;
+            ow_hal_arm(5);
+            break;
+        case ST_SLOT:
+            slot();
+            break;
+    }
+    run=ow_hal_cycles()-start;
+    if (run>ow_stats.isr_max) ow_stats.isr_max=run;
+    ow_stats.isr_cycles+=run;
+}
+
+static int start(const uint8_t *tx, int tx_len, uint8_t *rx, int rx_len, bool search) {
+    if (!ready) return OW_ERR_PRESENCE;
+#ifndef OW_HOST
+    waiter=xTaskGetCurrentTaskHandle();
+#endif
+    t.tx=tx; t.tx_bits=tx_len*8;
+    t.rx=rx; t.rx_bits=rx_len*8;
+    t.bit=t.step=t.late=0;
+    t.search=search;
+    cpufreq_pin(); //a switch would change the rate of the cycle counter the slots are timed with
+    t.mhz=OW_CYCLES_PER_US;
+    ow_stats.transactions++;
+    t.state=ST_RESET;
+    ow_hal_low();
+    ow_hal_arm(480);
+    if (!ow_hal_wait()) {
+        ow_hal_stop();
+        t.state=ST_IDLE;
+        ow_stats.errors++;
+        cpufreq_unpin();
+        return OW_ERR_TIMEOUT;
+    }
+    cpufreq_unpin();
+    return t.result;
+}
+
+void ow_init(int pin) {
+    ow_hal_init(pin);
+    ready=true;
+}
+
+uint8_t ow_crc8(const uint8_t *data, int len) { //Dallas/Maxim, 0 over data plus its crc byte
+    uint8_t crc=0;
+    while (len--) {
+        crc^=*data++;
+        for (int k=0; k<8; k++) crc=crc&1 ? (crc>>1)^0x8c : crc>>1;
+    }
+    return crc;
+}
+
+int ow_xfer(const uint8_t *tx, int tx_len, uint8_t *rx, int rx_len) {
+    if (rx_len) memset(rx, 0, rx_len);
+    return start(tx, tx_len, rx, rx_len, false);
+}
+
+static void rom_bytes(uint8_t *p, uint64_t rom) {
+    for (int k=0; k<8; k++) p[k]=rom>>(8*k);
+}
+
+int ow_search(uint64_t *addrs, int max) {
+    static const uint8_t search_rom=0xf0;
+    uint8_t rom[8];
+    int     found=0, result;
+
+    t.last=-1; t.rom=0;
+    do {
+        t.last_zero=-1;
+        if ((result=start(&search_rom, 1, NULL, 0, true))) return found ? found : result;
+        rom_bytes(rom, t.rom);
+        if (!t.rom || ow_crc8(rom, 8)) { //all zero passes the crc, that is a line stuck low
+            ow_stats.errors++;
+            return found ? found : OW_ERR_CRC;
+        }
+        addrs[found++]=t.rom;
+        t.last=t.last_zero;
+    } while (t.last>=0 && found<max);
+    return found;
+}
+
+#ifndef OW_HOST
+void ow_report(void) {
+    uint32_t mhz=OW_CYCLES_PER_US;
+    LOG_I("onewire: %u transactions %u errors %u late %u slots, interrupt masked max %u us, %u us in total\n",
+            ow_stats.transactions, ow_stats.errors, ow_stats.late, ow_stats.slots, ow_stats.isr_max/mhz,
+            ow_stats.isr_cycles/mhz);
+    memset(&ow_stats, 0, sizeof(ow_stats));
+}
+#endif
+
+int ow_ds18b20_scan_devices(int pin, uint64_t *addrs, int max) {
+    if (!ready) ow_init(pin);
+    return ow_search(addrs, max);
+}
+
+bool ow_ds18b20_measure(int pin, uint64_t addr, bool wait) {
+    uint8_t cmd[10];
+    int     n=0;
+    if (!ready) ow_init(pin);
+    if (addr==~(uint64_t)0) cmd[n++]=0xcc; //skip ROM, all sensors convert at once
+    else {cmd[n++]=0x55; rom_bytes(cmd+n, addr); n+=8;}
+    cmd[n++]=0x44;
+    if (ow_xfer(cmd, n, NULL, 0)) return false;
+    if (wait) ow_hal_sleep(750);
+    return true;
+}
+
+bool ow_ds18b20_read_temp_multi(int pin, uint64_t *addrs, int count, float *temps) {
+    uint8_t cmd[10], pad[9];
+    bool    ok=true;
+    if (!ready) ow_init(pin);
+    for (int i=0; i<count; i++) {
+        cmd[0]=0x55; rom_bytes(cmd+1, addrs[i]); cmd[9]=0xbe; //match ROM, read scratchpad
+        int result=ow_xfer(cmd, sizeof(cmd), pad, sizeof(pad));
+        if (!result && (ow_crc8(pad, sizeof(pad)) || (pad[4]&0x9f)!=0x1f)) { //the config byte has fixed bits
+            ow_stats.errors++;
+            result=OW_ERR_CRC;
+        }
+        if (result) {
+            temps[i]=NAN;
+            ok=false;
+            continue;
+        }
+        temps[i]=(int16_t)(pad[1]<<8 | pad[0])/16.0f;
+    }
+    return ok;
+}
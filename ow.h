@@ -0,0 +1,46 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Timer driven 1-Wire master, an alternative to the bit-banged extras/onewire (make ONEWIRE_TIMER=1)
+ *  a FRC1 interrupt runs each bit slot as a state machine, the calling task sleeps until the transaction is done
+ *  only the parts of a slot that must be shorter than 15 us are timed with interrupts masked:
+ *    write 1  6 us low,  write 0  nothing (60 us low through the timer),  read  2 us low and sample at 13 us
+ *  the longest masked stretch is one ISR run and is measured in CPU cycles, see ow_report
+ *  the ds18b20 calls of main.c map onto ow_ds18b20_* with the same arguments
+ *  FRC1 is then owned by this driver, so no pwm or other FRC1 user in the same build
+ *  tools/owemu emulates the bus with virtual DS18B20s to test the state machine and the ROM search on the host
+ */
+#ifndef __OW_H__
+#define __OW_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define OW_OK           0
+#define OW_ERR_PRESENCE -1 //nobody answered the reset
+#define OW_ERR_TIMEOUT  -2 //the interrupt did not finish the transaction
+#define OW_ERR_SEARCH   -3 //inconsistent ROM search
+#define OW_ERR_CRC      -4
+#define OW_ERR_LATE     -5 //interrupt latency kept missing the presence pulse
+
+#define OW_TIMEOUT 100     //in milliseconds for one transaction
+#define OW_RETRIES   8     //resets when the presence pulse was sampled too late
+
+typedef struct ow_stats {
+    uint32_t transactions, errors, late, slots;
+    uint32_t isr_max;      //longest interrupt run in CPU cycles, the interrupt masked time
+    uint32_t isr_cycles;   //all interrupt runs together
+} ow_stats_t;
+
+extern ow_stats_t ow_stats;
+
+void ow_init(int pin);
+int  ow_xfer(const uint8_t *tx, int tx_len, uint8_t *rx, int rx_len); //reset, write tx, read rx
+int  ow_search(uint64_t *addrs, int max);                             //ROM search, number found or an error
+uint8_t ow_crc8(const uint8_t *data, int len);
+void ow_report(void);
+
+//drop-in for the ds18b20 extras calls
+int  ow_ds18b20_scan_devices(int pin, uint64_t *addrs, int max);
+bool ow_ds18b20_measure(int pin, uint64_t addr, bool wait);
+bool ow_ds18b20_read_temp_multi(int pin, uint64_t *addrs, int count, float *temps);
+
+#endif // __OW_H__
@@ -13,6 +13,7 @@
 #include "lwip/dns.h"
 #include "lwip/netdb.h"
 #include "ping.h"
+#include "power.h"
 
 #ifndef LWIP_RAW
 #error "LWIP_RAW must be activated in lwipopts.h"
@@ -46,15 +47,11 @@ static void ping_prepare_echo(struct icmp_echo_hdr *iecho, u16_t len) {
 
 static err_t ping_send(int sock, const ip_addr_t *addr) { //Ping using the socket ip
     int err;
-    struct icmp_echo_hdr *iecho;
+    u32_t packet[(sizeof(struct icmp_echo_hdr) + PING_DATA_SIZE + 3)/4]; //word aligned for inet_chksum
+    struct icmp_echo_hdr *iecho = (struct icmp_echo_hdr*) packet;
     struct sockaddr_storage to;
     size_t ping_size = sizeof(struct icmp_echo_hdr) + PING_DATA_SIZE;
 
-    iecho = (struct icmp_echo_hdr*) mem_malloc((mem_size_t) ping_size);
-    if (!iecho) {
-        return ERR_MEM;
-    }
-
     ping_prepare_echo(iecho, (u16_t) ping_size);
 
     if (IP_IS_V4(addr)) {
@@ -64,21 +61,20 @@ static err_t ping_send(int sock, const ip_addr_t *addr) { //Ping using the socke
         inet_addr_from_ip4addr(&to4->sin_addr, ip_2_ip4(addr));
     }
 
+    power_tx();
     err = lwip_sendto(sock, iecho, ping_size, 0, (struct sockaddr*) &to,
             sizeof(to));
 
-    mem_free(iecho);
-
     return (err ? ERR_OK : ERR_VAL);
 }
 
-static void ping_recv(int sock, ping_result_t *res) {
+static void ping_recv(int sock, ping_result_t *res) { //what arrived so far, never waits
     char buf[64];
     int len;
     struct sockaddr_storage from;
     int fromlen = sizeof(from);
 
-    while ((len = lwip_recvfrom(sock, buf, sizeof(buf), 0, (struct sockaddr*) &from, (socklen_t*) &fromlen)) > 0) {
+    while ((len = lwip_recvfrom(sock, buf, sizeof(buf), MSG_DONTWAIT, (struct sockaddr*) &from, (socklen_t*) &fromlen)) > 0) {
         if (len >= (int) (sizeof(struct ip_hdr) + sizeof(struct icmp_echo_hdr))) { //received something usefull
             ip_addr_t fromaddr;
             memset(&fromaddr, 0, sizeof(fromaddr));
@@ -122,53 +118,50 @@ static void ping_recv(int sock, ping_result_t *res) {
         }
         fromlen = sizeof(from);
     }
-
-    if (len == -1) { //timeout (should verify if error==11)
-        res->response_time_ms = UINT32_MAX;
-        res->result_code = PING_RES_TIMEOUT;
-    }
 }
 
-void ping_ip(ip_addr_t ping_target, ping_result_t *res) {
-    int sock;
-    int ret;
+static int   ping_sock=-1; //kept open between pings, so no allocations in steady state
+static bool  pending=false;
+static u32_t pending_since;
+
+int ping_start(ip_addr_t ping_target, ping_result_t *res) {
     err_t err;
+    char  junk[8];
 
     if (res == NULL) {
-        return;
+        return -1;
     }
     res->result_code = PING_RES_INITIAL_VALUE_UNCHANGED;
     res->response_time_ms=0;
     inet_aton("0.0.0.0",&res->response_ip);
-    
-    struct timeval timeout;
-    timeout.tv_sec = PING_RCV_TIMEO / 1000;
-    timeout.tv_usec = (PING_RCV_TIMEO % 1000) * 1000;
 
-    fflush(stdout);
-    sock = lwip_socket(AF_INET, SOCK_RAW, IP_PROTO_ICMP);
-
-    fflush(stdout);
-
-    if (sock < 0) {
+    if (ping_sock < 0 && (ping_sock = lwip_socket(AF_INET, SOCK_RAW, IP_PROTO_ICMP)) < 0) {
         res->result_code = PING_RES_ERR_NO_SOCKET;
-        return;
+        return -1;
     }
+    //anything ICMP that queued up since the last probe (echo requests, port unreachables) would fill the
+    //DEFAULT_RAW_RECVMBOX_SIZE entries and the reply of the hub would be dropped
+    while (lwip_recv(ping_sock, junk, sizeof(junk), MSG_DONTWAIT) > 0);
+    if ((err = ping_send(ping_sock, &ping_target)) != ERR_OK) {
+        res->result_code = (err == ERR_MEM) ? PING_RES_NO_MEM : PING_RES_ERR_SENDING;
+        lwip_close(ping_sock); ping_sock=-1; //start afresh next time
+        return -1;
+    }
+    pending = true;
+    pending_since = res->response_time_ms = sys_now();
+    return 0;
+}
 
-    ret = lwip_setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-    LWIP_ASSERT("setting receive timeout failed", ret == 0);
-    LWIP_UNUSED_ARG(ret);
-
-    if ((err = ping_send(sock, &ping_target)) == ERR_OK) {
-        //modified later
-        res->response_time_ms = sys_now();
-        ping_recv(sock, res);
-    } else {
-        if (err == ERR_VAL) {
-            res->result_code = PING_RES_ERR_SENDING;
-        } else if (err == ERR_MEM) {
-            res->result_code = PING_RES_NO_MEM;
-        }
+bool ping_poll(ping_result_t *res) {
+    if (!pending) return true;
+    res->response_time_ms = pending_since;
+    ping_recv(ping_sock, res); //late replies of earlier pings are dropped by the seqno check
+    if (res->result_code == PING_RES_INITIAL_VALUE_UNCHANGED || res->result_code == PING_RES_ID_OR_SEQNUM_MISMATCH) {
+        res->response_time_ms = 0;
+        if (sys_now() - pending_since < PING_RCV_TIMEO) return false; //keep waiting
+        res->response_time_ms = UINT32_MAX;
+        res->result_code = PING_RES_TIMEOUT;
     }
-    lwip_close(sock);
+    pending = false;
+    return true;
 }
@@ -2,6 +2,7 @@
 #ifndef LWIP_PING_H
 #define LWIP_PING_H
 
+#include <stdbool.h>
 #include "lwip/ip_addr.h"
 
 typedef enum {
@@ -23,6 +24,9 @@ typedef struct {
     ip_addr_t response_ip;
 } ping_result_t;
 
-void ping_ip(ip_addr_t ping_addr, ping_result_t *res);
+//ping_start sends the echo request, then call ping_poll until it returns true, it times out after PING_RCV_TIMEO
+//neither blocks, so the ping job does not hold up the other jobs of the scheduler task
+int  ping_start(ip_addr_t ping_addr, ping_result_t *res);
+bool ping_poll(ping_result_t *res);
 
 #endif /* LWIP_PING_H */
@@ -0,0 +1,42 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Low power mode and radio on time estimate, see power.h
+ */
+#include <espressif/esp_wifi.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include "logsink.h"
+#include "power.h"
+
+power_counters_t power;
+static uint32_t burst_start, last_tx;
+
+static uint32_t now_ms(void) {
+    return xTaskGetTickCount()*portTICK_PERIOD_MS;
+}
+
+void power_tx(void) { //called from several tasks, a lost update only shifts the estimate
+    uint32_t now=now_ms();
+    power.tx++;
+    if (!power.bursts || now-last_tx>POWER_TAIL) {
+        if (power.bursts) power.on_ms+=last_tx-burst_start+POWER_TAIL; //close the previous burst
+        power.bursts++;
+        burst_start=now;
+    }
+    last_tx=now;
+}
+
+void power_report(void) {
+    uint32_t now=now_ms(), period=now-power.since, on=power.on_ms, duty;
+    if (power.bursts) on+=(now-last_tx<POWER_TAIL ? now : last_tx+POWER_TAIL)-burst_start; //burst still open
+    duty=period ? (uint64_t)on*10000/period : 0; //in 0.01%
+    LOG_I("radio: %u transmits in %u bursts, about %u ms on in %u s = %u.%02u%% plus beacon listening, sleep type %d\n",
+            power.tx, power.bursts, on, period/1000, duty/100, duty%100, sdk_wifi_get_sleep_type());
+    power.tx=power.bursts=power.on_ms=0;
+    power.since=now;
+}
+
+void power_init(int mode) {
+    static const enum sdk_sleep_type type[]={WIFI_SLEEP_MODEM, WIFI_SLEEP_LIGHT};
+    if (mode==1 || mode==2) sdk_wifi_set_sleep_type(type[mode-1]);
+    power.since=now_ms();
+}
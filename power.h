@@ -0,0 +1,26 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Low power mode: Wi-Fi modem or light sleep, with all periodic network activity in one burst per beat
+ *  every place that transmits calls power_tx, a transmit more than POWER_TAIL ms after the previous one
+ *  wakes the radio again, so the bursts and their length estimate the radio on time on top of the beacon listening
+ *  tools/radiosim runs the same estimate over a simulated hour of both schedules
+ */
+#ifndef __POWER_H__
+#define __POWER_H__
+
+#include <stdint.h>
+
+#define POWER_TAIL  100 //ms the radio stays on after the last transmit before it sleeps again
+
+typedef struct power_counters {
+    uint32_t tx, bursts;
+    uint32_t on_ms;  //estimated radio on time caused by our transmits
+    uint32_t since;  //ms at the start of the counting period
+} power_counters_t;
+
+extern power_counters_t power;
+
+void power_init(int mode); //0 keeps the sleep type of the SDK (modem sleep), 1 modem sleep, 2 light sleep
+void power_tx(void);
+void power_report(void);   //logs the counters and starts a new period
+
+#endif // __POWER_H__
@@ -0,0 +1,118 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Statistical CPU profiler, see profile.h
+ */
+#ifdef PROFILE
+#if defined(ONEWIRE_TIMER)
+#error PROFILE and ONEWIRE_TIMER both need FRC1
+#endif
+#include <stdbool.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <esp8266.h>
+#include <xtensa_ops.h>
+#include <espressif/esp_system.h>
+#include <espressif/esp_sta.h>
+#include <espressif/esp_wifi.h>
+#include "lwip/sockets.h"
+#include "scheduler.h"
+#include "logsink.h"
+#include "stats.h"
+#include "profile.h"
+
+enum {KIND_HISTOGRAM, KIND_NAMES};
+#define NAME 14 //chars of a task name in the names packet
+
+//the histogram is built where it is sent from: header, task counts, buckets
+static uint32_t packet[PROFILE_HEADER/4+PROFILE_TASKS+PROFILE_SLOTS];
+#define TASKS ((uint16_t*)(packet+PROFILE_HEADER/4)) //pairs of task and count
+#define SLOTS (packet+PROFILE_HEADER/4+PROFILE_TASKS)
+static volatile bool sending=false;
+static uint32_t samples, lost;
+static uint16_t seq;
+static int      sock=-1;
+
+static void IRAM profile_isr(void *arg) {
+    uint32_t pc, off, key, h, e;
+    uint16_t task=(uintptr_t)xTaskGetCurrentTaskHandle()>>2, *t=TASKS;
+    int      i;
+
+    if (sending) return;
+    RSR(pc, epc1);
+    samples++;
+    if      ((off=pc-0x40000000)<0x10000)  key=PROFILE_ROM<<16  | off>>4;
+    else if ((off=pc-0x40100000)<0x8000)   key=PROFILE_IRAM<<16 | off>>4;
+    else if ((off=pc-0x40200000)<0x100000) key=PROFILE_IROM<<16 | off>>4;
+    else key=PROFILE_OTHER<<16;
+    for (i=0; i<PROFILE_TASKS; i++, t+=2) {
+        if (!t[1]) {t[0]=task; t[1]=1; break;}
+        if (t[0]==task) {t[1]++; break;}
+    }
+    h=(key*2654435761u)>>24; //PROFILE_SLOTS is 256
+    for (i=0; i<8; i++, h=(h+1)&(PROFILE_SLOTS-1)) {
+        e=SLOTS[h];
+        if (!e) {SLOTS[h]=key<<PROFILE_COUNT_BITS | 1; return;}
+        if (e>>PROFILE_COUNT_BITS==key) {
+            if (~e&((1<<PROFILE_COUNT_BITS)-1)) SLOTS[h]=e+1;
+            return;
+        }
+    }
+    lost++;
+}
+
+static void send(int kind, int buckets, int tasks, int len) {
+    struct sockaddr_in to={.sin_family=AF_INET, .sin_port=htons(PROFILE_PORT), .sin_addr.s_addr=htonl(INADDR_BROADCAST)};
+    uint8_t *h=(uint8_t*)packet;
+    packet[0]=PROFILE_MAGIC;
+    h[4]=seq; h[5]=seq>>8; seq++;
+    h[6]=kind;
+    h[7]=sdk_system_get_cpu_freq();
+    h[8]=samples; h[9]=samples>>8;
+    h[10]=lost;   h[11]=lost>>8;
+    h[12]=buckets; h[13]=buckets>>8;
+    h[14]=tasks; h[15]=0;
+    if (sock<0) sock=lwip_socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock>=0) lwip_sendto(sock, packet, PROFILE_HEADER+len, 0, (struct sockaddr*)&to, sizeof(to));
+}
+
+static void send_names(void) { //the task handles of the histogram get a name now and then
+    TaskStatus_t *status;
+    uint8_t *p=(uint8_t*)(packet+PROFILE_HEADER/4);
+    int n=stats_tasks(&status);
+    if (n>(PROFILE_TASKS+PROFILE_SLOTS)*4/(2+NAME)) n=(PROFILE_TASKS+PROFILE_SLOTS)*4/(2+NAME);
+    for (int i=0; i<n; i++, p+=2+NAME) {
+        uint16_t task=(uintptr_t)status[i].xHandle>>2;
+        p[0]=task; p[1]=task>>8;
+        strncpy((char*)p+2, status[i].pcTaskName, NAME);
+    }
+    send(KIND_NAMES, 0, n, n*(2+NAME));
+}
+
+static void profile_job(void *arg) {
+    static int runs=0;
+    uint32_t *out;
+    int tasks, buckets=0;
+
+    sending=true; //the interrupt leaves the histogram alone until it is cleared
+    if (sdk_wifi_station_get_connect_status()==STATION_GOT_IP) {
+        for (tasks=0; tasks<PROFILE_TASKS && TASKS[2*tasks+1]; tasks++);
+        out=packet+PROFILE_HEADER/4+tasks; //buckets move down to follow the tasks in use
+        for (int i=0; i<PROFILE_SLOTS; i++) if (SLOTS[i]) out[buckets++]=SLOTS[i];
+        send(KIND_HISTOGRAM, buckets, tasks, (tasks+buckets)*4);
+        if (!(runs++%10)) send_names();
+    }
+    memset(packet+PROFILE_HEADER/4, 0, (PROFILE_TASKS+PROFILE_SLOTS)*4);
+    samples=lost=0;
+    sending=false;
+}
+static sched_job_t profiler=SCHED_JOB(profile_job,NULL);
+
+void profile_init(void) {
+    _xt_isr_attach(INUM_TIMER_FRC1, profile_isr, NULL);
+    timer_set_frequency(FRC1, PROFILE);
+    timer_set_interrupts(FRC1, true);
+    timer_set_run(FRC1, true);
+    LOG_I("profile: %d Hz to UDP port %d every %d s\n", PROFILE, PROFILE_PORT, PROFILE_PERIOD);
+    sched_add(&profiler, PROFILE_PERIOD*1000, PROFILE_PERIOD*1000);
+}
+#endif //PROFILE
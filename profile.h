@@ -0,0 +1,37 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Statistical CPU profiler (make PROFILE=997, the sample rate in Hz, a prime so it does not beat with the tick)
+ *  a FRC1 interrupt samples the interrupted PC (EPC1) into a histogram of 16 byte buckets, plus which task ran
+ *  every PROFILE_PERIOD seconds a scheduler job sends it to UDP port PROFILE_PORT and starts again
+ *  tools/profsym symbolises the buckets against the ELF and prints flat and folded (flamegraph) output
+ *  code that runs with interrupts masked is sampled when it unmasks them, so critical sections show up
+ *  at their exit; the call0 ABI has no frame chain to walk, so the folded stacks are component;function
+ *  FRC1 is then owned by the profiler, so not together with ONEWIRE_TIMER
+ */
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <stdint.h>
+
+#define PROFILE_PORT   45681
+#define PROFILE_MAGIC  0x31465250 //"PRF1"
+#define PROFILE_SLOTS  256        //buckets, power of 2
+#define PROFILE_TASKS  16
+#define PROFILE_PERIOD 2          //in seconds
+#define PROFILE_HEADER 16         //magic, seq, mhz, rate, samples, lost, buckets, tasks
+
+//a bucket is region<<16 | offset/16 in the top 18 bits and a count in the low 14
+enum {PROFILE_ROM, PROFILE_IRAM, PROFILE_IROM, PROFILE_OTHER};
+#define PROFILE_COUNT_BITS 14
+
+#ifdef PROFILE
+#if PROFILE<=0
+#error PROFILE is the sample rate in Hz, leave it out to build without the profiler
+#endif
+#define PROFILE_RAM (PROFILE_HEADER+(PROFILE_TASKS+PROFILE_SLOTS)*4)
+void profile_init(void);
+#else
+#define PROFILE_RAM 0
+#define profile_init() do {} while(0)
+#endif
+
+#endif // __PROFILE_H__
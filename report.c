@@ -0,0 +1,66 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Report-on-change of values to Domoticz over MQTT
+ */
+#include <math.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include "mqtt-client.h"
+#include "blog.h"
+#include "logsink.h"
+#include "report.h"
+#include "trace.h"
+
+static report_t *table;
+static int      count=0, idx;
+
+static bool moved(report_t *ch) {
+    if (ch->deadband<0) return true; //every report is published
+    return ch->value!=ch->sent && fabsf(ch->value-ch->sent)>=ch->deadband;
+}
+
+static void publish(report_t *ch, uint32_t now) {
+    TRACE_BEGIN(REPORT);
+    int n=mqtt_client_publish("{\"idx\":%d,\"nvalue\":0,\"svalue\":\"%.1f\"}", idx+ch->ix, ch->value);
+    TRACE_END(REPORT);
+    if (n<0) {
+        BLOG(MQTT_FAIL,ch->name,MQTT_CLIENT_ERROR(n));
+        ch->failed++; //stays unpublished, next report or heartbeat tries again
+        return;
+    }
+    ch->sent=ch->value;
+    ch->last=now;
+    ch->ever=true;
+    ch->published++;
+}
+
+void report(report_t *ch, float value) {
+    uint32_t now=xTaskGetTickCount()*portTICK_PERIOD_MS;
+    
+    ch->value=value*ch->scale;
+    ch->valid=true;
+    if (!ch->ever || (moved(ch) && now-ch->last>=ch->min_interval*1000)
+                  || (ch->max_interval && now-ch->last>=ch->max_interval*1000)) publish(ch, now);
+    else ch->suppressed++;
+}
+
+void report_heartbeat(void) {
+    uint32_t now=xTaskGetTickCount()*portTICK_PERIOD_MS;
+    
+    for (int i=0; i<count; i++) {
+        report_t *ch=table+i;
+        if (!ch->valid) continue;
+        if ((ch->ever && ch->max_interval && now-ch->last>=ch->max_interval*1000)
+            || (ch->deadband>=0 && moved(ch) && now-ch->last>=ch->min_interval*1000)) publish(ch, now); //also catches up suppressed changes
+    }
+}
+
+void report_stats(void) {
+    for (int i=0; i<count; i++) LOG_I("report %-6s idx=%d published=%u suppressed=%u failed=%u\n",
+            table[i].name, idx+table[i].ix, table[i].published, table[i].suppressed, table[i].failed);
+}
+
+void report_init(report_t *report_table, int report_count, int base_idx) {
+    table=report_table;
+    count=report_count;
+    idx=base_idx;
+}
@@ -0,0 +1,35 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Report-on-change of values to Domoticz over MQTT
+ *  a table of channels, each with its Domoticz idx offset, scale, deadband and min/max report interval
+ *  report() publishes a value only if it moved beyond the deadband and min_interval has passed,
+ *  report_heartbeat() republishes channels that were quiet for max_interval
+ *  all calls for one table must come from the same task
+ */
+#ifndef __REPORT_H__
+#define __REPORT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define REPORT_TICK 60 //in seconds, publish_task calls report_heartbeat and catches up rate limited changes
+
+typedef struct report_channel {
+    const char *name;
+    int      ix;           //added to the Domoticz base idx
+    float    scale;        //published value is scale*value
+    float    deadband;     //in published units
+    uint32_t min_interval; //seconds
+    uint32_t max_interval; //seconds, heartbeat even if unchanged, 0 for never
+    float    value, sent;  //latest and last published value, scaled
+    uint32_t last;         //ms of last publish
+    bool     valid, ever;
+    uint32_t published, suppressed, failed;
+} report_t;
+#define REPORT_CHANNEL(name, ix, scale, deadband, min_s, max_s) {name, ix, scale, deadband, min_s, max_s}
+
+void report_init(report_t *table, int count, int base_idx);
+void report(report_t *channel, float value);
+void report_heartbeat(void);
+void report_stats(void);
+
+#endif // __REPORT_H__
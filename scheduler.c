@@ -0,0 +1,90 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Jobs are kept in a list sorted by due time, so the task sleeps until the first one is due
+ *  or until a message arrives. With a handful of jobs this beats a timer wheel on size and speed
+ */
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+#include "scheduler.h"
+
+#define SCHED_CANCEL    -1
+
+static QueueHandle_t sched_queue=NULL;
+static TaskHandle_t  sched_handle=NULL;
+static sched_job_t   *jobs=NULL; //sorted by due time, only touched by sched_task
+
+static void unlink_job(sched_job_t *job) {
+    sched_job_t **pp;
+    for (pp=&jobs; *pp; pp=&(*pp)->next) if (*pp==job) {*pp=job->next; break;}
+    job->next=NULL;
+}
+
+static void insert_job(sched_job_t *job) {
+    sched_job_t **pp;
+    for (pp=&jobs; *pp && (int)((*pp)->due-job->due)<=0; pp=&(*pp)->next);
+    job->next=*pp;
+    *pp=job;
+}
+
+static void handle(sched_msg_t *msg) {
+    if (!msg->job) {
+        msg->fn(msg->arg);
+        return;
+    }
+    unlink_job(msg->job);
+    if (msg->delay==SCHED_CANCEL) return;
+    msg->job->period=msg->period;
+    msg->job->due=xTaskGetTickCount()+msg->delay;
+    insert_job(msg->job);
+}
+
+static void sched_task(void *argv) {
+    sched_msg_t msg;
+    sched_job_t *job;
+    TickType_t  now, wait;
+    
+    while (1) {
+        now=xTaskGetTickCount();
+        while (jobs && (int)(jobs->due-now)<=0) {
+            job=jobs; jobs=job->next; job->next=NULL;
+            if (job->period) {
+                job->due+=job->period;
+                if ((int)(job->due-now)<=0) job->due=now+job->period; //do not catch up on missed periods
+                insert_job(job);
+            }
+            job->fn(job->arg); //may call sched_add on itself, which is handled directly
+            now=xTaskGetTickCount();
+        }
+        wait=jobs ? jobs->due-now : portMAX_DELAY;
+        if (xQueueReceive(sched_queue, &msg, wait) == pdTRUE) handle(&msg);
+    }
+}
+
+static int send(sched_msg_t *msg) {
+    if (!sched_queue) return -1;
+    if (xTaskGetCurrentTaskHandle()==sched_handle) { //called from a job, no need to queue
+        handle(msg);
+        return 0;
+    }
+    return (xQueueSend(sched_queue, msg, 0) == pdTRUE) ? 0 : -1; //never block the caller
+}
+
+int sched_add(sched_job_t *job, int delay_ms, int period_ms) {
+    sched_msg_t msg={job,NULL,NULL,delay_ms/portTICK_PERIOD_MS,period_ms/portTICK_PERIOD_MS};
+    return send(&msg);
+}
+
+int sched_cancel(sched_job_t *job) {
+    sched_msg_t msg={job,NULL,NULL,SCHED_CANCEL,0};
+    return send(&msg);
+}
+
+int sched_post(sched_fn_t fn, void *arg) {
+    sched_msg_t msg={NULL,fn,arg,0,0};
+    return send(&msg);
+}
+
+void sched_init(int stack_depth, int priority) {
+    sched_queue = xQueueCreate(SCHED_QUEUE_SIZE, sizeof(sched_msg_t));
+    xTaskCreate(sched_task, "Sched", stack_depth, NULL, priority, &sched_handle);
+}
@@ -0,0 +1,39 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  A single task that runs all periodic and one-shot jobs of the application
+ *  a job is a static sched_job_t initialised with SCHED_JOB(function,argument)
+ *  sched_add (re)schedules it after delay_ms and then every period_ms (0 = one-shot)
+ *  sched_post runs a function once, as soon as possible, in the scheduler context
+ *  jobs must not block for long since they delay all other jobs
+ */
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include <FreeRTOS.h>
+
+#define SCHED_QUEUE_SIZE 8
+
+typedef void (*sched_fn_t)(void *arg);
+
+typedef struct sched_job {
+    sched_fn_t fn;
+    void       *arg;
+    TickType_t period; //0 for one-shot
+    TickType_t due;
+    struct sched_job *next;
+} sched_job_t;
+#define SCHED_JOB(function,argument) {function,argument,0,0,NULL}
+
+typedef struct sched_msg { //what the queue carries, here for the memory budget
+    sched_job_t *job; //NULL means run fn(arg) now
+    sched_fn_t  fn;
+    void        *arg;
+    int         delay; //in ticks, SCHED_CANCEL to remove the job
+    int         period;
+} sched_msg_t;
+
+void sched_init(int stack_depth, int priority);
+int  sched_add(sched_job_t *job, int delay_ms, int period_ms);
+int  sched_cancel(sched_job_t *job);
+int  sched_post(sched_fn_t fn, void *arg);
+
+#endif // __SCHEDULER_H__
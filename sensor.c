@@ -0,0 +1,111 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  DS18B20 acquisition with retries and a spike filter, see sensor.h
+ */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sensor.h"
+
+#ifdef SENSOR_HOST //tools/owemu reads through ow.c
+#define ds18b20_read_temp_multi ow_ds18b20_read_temp_multi
+#else
+#include "ds18b20/ds18b20.h"
+#ifdef ONEWIRE_TIMER
+#include "ow.h"
+#define ds18b20_read_temp_multi ow_ds18b20_read_temp_multi
+#endif
+#include "logsink.h"
+#endif
+
+sensor_stats_t sensor_stats[SENSOR_MAX];
+
+typedef struct filter {
+    int16_t hist[3]; //the last three good values in 1/16 C, newest first
+    int16_t out;     //what was handed out last
+    bool    primed;  //hist holds values
+    uint8_t missed;  //beats without a value in a row
+} filter_t;
+
+static filter_t filter[SENSOR_MAX];
+static uint32_t bus_errors; //only written by sensor_read, sensor_health keeps its own mark
+static uint64_t *rom;
+static int      roms;
+
+static int16_t median(const int16_t *h) {
+    int16_t a=h[0], b=h[1], c=h[2];
+    if (a>b) {int16_t x=a; a=b; b=x;}
+    return c<a ? a : c>b ? b : c;
+}
+
+static bool good(int i, float t) { //a read that passed the CRC can still be the power up value
+    if (isnan(t)) return false;
+    int16_t raw=lroundf(t*16);
+    return raw!=SENSOR_POR || (filter[i].primed && abs(raw-filter[i].out)<=SENSOR_SPIKE);
+}
+
+static float accept(int i, int16_t raw) {
+    filter_t *f=filter+i;
+    f->missed=0;
+    if (!f->primed) { //first value, or the first after a long failure
+        f->hist[0]=f->hist[1]=f->hist[2]=f->out=raw;
+        f->primed=true;
+        return raw/16.0F;
+    }
+    f->hist[2]=f->hist[1]; f->hist[1]=f->hist[0]; f->hist[0]=raw;
+    if (abs(raw-f->out)<=SENSOR_SPIKE) f->out=raw;
+    else {
+        f->out=median(f->hist);
+        if (f->out!=raw) sensor_stats[i].spikes++;
+    }
+    return f->out/16.0F;
+}
+
+static float missing(int i) {
+    if (filter[i].primed && ++filter[i].missed<=SENSOR_HOLD) {
+        sensor_stats[i].held++;
+        return filter[i].out/16.0F;
+    }
+    filter[i].primed=false; //stale, start over with the next value
+    return NAN;
+}
+
+void sensor_read(int pin, uint64_t *addrs, int count, float *temps) {
+    float t;
+    if (count>SENSOR_MAX) count=SENSOR_MAX;
+    rom=addrs; roms=count;
+    ds18b20_read_temp_multi(pin, addrs, count, temps);
+    for (int i=0; i<count; i++) {
+        int tries=0;
+        t=temps[i];
+        while (isnan(t) && tries++<SENSOR_RETRIES) { //the scratchpad still holds the same conversion
+            bus_errors++;
+            ds18b20_read_temp_multi(pin, addrs+i, 1, &t);
+        }
+        if (isnan(t)) bus_errors++;
+        if (!good(i, t)) {
+            sensor_stats[i].failed++;
+            temps[i]=missing(i);
+            continue;
+        }
+        sensor_stats[i].reads++;
+        if (tries) sensor_stats[i].retried++;
+        temps[i]=accept(i, lroundf(t*16));
+    }
+}
+
+uint32_t sensor_health(void) {
+    static uint32_t mark;
+    uint32_t errors=bus_errors-mark;
+    mark+=errors;
+    return errors;
+}
+
+#ifndef SENSOR_HOST
+void sensor_report(void) {
+    for (int i=0; i<roms; i++) LOG_I("sensor %08x%08x: %u reads %u retried %u failed %u spikes %u held\n",
+            (uint32_t)(rom[i]>>32), (uint32_t)rom[i], sensor_stats[i].reads, sensor_stats[i].retried,
+            sensor_stats[i].failed, sensor_stats[i].spikes, sensor_stats[i].held);
+    memset(sensor_stats, 0, sizeof(sensor_stats));
+}
+#endif
@@ -0,0 +1,36 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  DS18B20 acquisition around ds18b20_read_temp_multi, once per beat after the conversion
+ *  a sensor whose scratchpad read fails (CRC, presence) is read again up to SENSOR_RETRIES times, that reads the
+ *  same conversion, so a bit flip on the bus costs a few ms and not a beat
+ *  the values are filtered in 1/16 C as the DS18B20 delivers them: a change of up to SENSOR_SPIKE passes at once,
+ *  a bigger one only when the next beat confirms it (median of the last three), so one bad read that passed the CRC
+ *  or the 85 C of a sensor that lost power cannot start the pump or enter the delta_out sampling
+ *  a failed sensor keeps its last value for SENSOR_HOLD beats and is NAN after that, as before
+ *  sensor_health() gives the failed scratchpad reads since its last call, retried ones included, for tBUS
+ */
+#ifndef __SENSOR_H__
+#define __SENSOR_H__
+
+#include <stdint.h>
+
+#define SENSOR_MAX      2
+#define SENSOR_RETRIES  2  //extra scratchpad reads of a failed sensor within the beat
+#define SENSOR_SPIKE   16  //in 1/16 C, a bigger change waits one beat for confirmation
+#define SENSOR_HOLD     3  //beats a failed sensor keeps its last value
+#define SENSOR_POR   1360  //85 C in 1/16 C, the scratchpad after power up before any conversion
+
+typedef struct sensor_stats {
+    uint32_t reads;   //beats with a value, also when it took retries
+    uint32_t retried; //beats that needed more than one read
+    uint32_t failed;  //beats without a value after all retries
+    uint32_t spikes;  //values replaced by the median
+    uint32_t held;    //beats that used the last value
+} sensor_stats_t;
+
+extern sensor_stats_t sensor_stats[SENSOR_MAX];
+
+void     sensor_read(int pin, uint64_t *addrs, int count, float *temps); //temps NAN when there is no value
+uint32_t sensor_health(void); //failed scratchpad reads since the last call
+void     sensor_report(void); //logs the counters per sensor and clears them
+
+#endif // __SENSOR_H__
@@ -0,0 +1,61 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Bulk TCP endpoint for tools/lwipsoak, see soak.h
+ */
+#ifdef SOAK
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include "lwip/sockets.h"
+#include "soak.h"
+
+#if defined(LWIP_LEAN) && LEAN_NETCONN_SOAK!=SOAK_NETCONN
+#error the lean lwIP profile must count the sockets of soak.c, see lwipopts.h
+#endif
+
+static uint8_t buf[SOAK_BUF];
+
+static int receive(int s, void *data, int len) { //all of it or -1
+    for (int i=0, n; i<len; i+=n) if ((n=lwip_recv(s, (uint8_t*)data+i, len-i, 0))<=0) return -1;
+    return len;
+}
+
+static int round_trip(int s) { //one length, its upload and its download, 0 if all went well
+    uint32_t len;
+    int      n;
+    if (receive(s, &len, 4)<0 || (len=ntohl(len))>SOAK_MAX) return -1;
+    for (uint32_t i=0; i<len; i+=n) {
+        if ((n=lwip_recv(s, buf, len-i<SOAK_BUF ? len-i : SOAK_BUF, 0))<=0) return -1;
+        for (int j=0; j<n; j++) if (buf[j]!=soak_pattern(i+j)) return -1;
+    }
+    for (uint32_t i=0; i<len; i+=n) {
+        n=len-i<SOAK_BUF ? len-i : SOAK_BUF;
+        for (int j=0; j<n; j++) buf[j]=soak_pattern(i+j);
+        if (lwip_send(s, buf, n, 0)!=n) return -1;
+    }
+    return 0;
+}
+
+static void soak_task(void *argv) {
+    struct sockaddr_in addr;
+    int listener, s;
+    
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_len = sizeof(addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(SOAK_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    listener=lwip_socket(AF_INET, SOCK_STREAM, 0);
+    if (listener<0 || lwip_bind(listener, (struct sockaddr*)&addr, sizeof(addr))<0 || lwip_listen(listener, 1)<0) {
+        vTaskDelete(NULL); //lwipsoak sees the connection refused
+    }
+    while (1) {
+        if ((s=lwip_accept(listener, NULL, NULL))<0) {vTaskDelay(1000/portTICK_PERIOD_MS); continue;}
+        while (!round_trip(s));
+        lwip_close(s);
+    }
+}
+
+void soak_init(int priority) {
+    xTaskCreate(soak_task, "Soak", SOAK_STACK, NULL, priority, NULL);
+}
+#endif //SOAK
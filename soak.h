@@ -0,0 +1,32 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Bulk TCP endpoint for tools/lwipsoak, only in a SOAK=1 build
+ *  what HomeKit answers an unverified session fits in one short segment, so it never exercises MSS, windows,
+ *  out of order queueing and SACK of the lwIP profile; this endpoint does
+ *  a client on SOAK_PORT sends a 4 byte length (network order) and that many bytes of a counting pattern, the device
+ *  checks them and sends the same number of pattern bytes back, then waits for the next length
+ *  one client at a time, a bad length or pattern closes the connection, lwipsoak counts that as an error
+ */
+#ifndef __SOAK_H__
+#define __SOAK_H__
+
+#include <stdint.h>
+
+#define SOAK_PORT  5557
+#define SOAK_BUF    256 //bytes per read and write, the stack still makes full segments of the writes
+#define SOAK_MAX  65536 //bytes per round
+
+static inline uint8_t soak_pattern(uint32_t i) {return i+(i>>8);} //also tools/lwipsoak
+
+#ifdef SOAK
+#define SOAK_STACK  192 //words, it does not log, that would not fit the budget
+#define SOAK_RAM    SOAK_BUF
+#define SOAK_NETCONN  2 //the listener and one client
+void soak_init(int priority);
+#else
+#define SOAK_STACK    0
+#define SOAK_RAM      0
+#define SOAK_NETCONN  0
+#define soak_init(priority) do {} while(0)
+#endif
+
+#endif // __SOAK_H__
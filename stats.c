@@ -0,0 +1,85 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Stack and heap high water marks
+ */
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <malloc.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include "logsink.h"
+#include "stats.h"
+
+stats_t stats={0,UINT32_MAX,0,0,INT32_MAX,"",0};
+
+static struct {
+    char  name[16];
+    int   hwm;   //lowest high water mark in words
+    int   prio;
+    bool  alive; //seen in the last sample
+} task_hwm[STATS_TASKS];
+static int tasks=0;
+#if configUSE_TRACE_FACILITY
+static TaskStatus_t status[STATS_TASKS]; //about 36 bytes each, too much for the stack of the scheduler task
+#endif
+
+static void note(const char *name, int hwm, int prio) {
+    int i;
+    for (i=0; i<tasks; i++) if (!strncmp(task_hwm[i].name,name,sizeof(task_hwm[i].name)-1)) break;
+    if (i==tasks) {
+        if (tasks==STATS_TASKS) return;
+        strncpy(task_hwm[i].name,name,sizeof(task_hwm[i].name)-1);
+        task_hwm[i].hwm=INT32_MAX;
+        tasks++;
+    }
+    task_hwm[i].alive=true;
+    task_hwm[i].prio=prio;
+    if (hwm<task_hwm[i].hwm) task_hwm[i].hwm=hwm;
+    if (hwm<stats.stack_min) {
+        stats.stack_min=hwm;
+        strncpy(stats.stack_min_task,name,sizeof(stats.stack_min_task)-1);
+    }
+}
+
+#if configUSE_TRACE_FACILITY
+int stats_tasks(TaskStatus_t **list) {
+    int n=uxTaskGetSystemState(status, STATS_TASKS, NULL);
+    if (!n) stats.tasks_missed=uxTaskGetNumberOfTasks(); //it fills nothing if the array is too small
+    *list=status;
+    return n;
+}
+#endif
+
+void stats_sample(void) {
+    struct mallinfo mi=mallinfo();
+    
+    stats.heap_free=xPortGetFreeHeapSize();
+    if (stats.heap_free<stats.heap_min) stats.heap_min=stats.heap_free;
+    stats.heap_frag=mi.fordblks;
+    stats.heap_top =stats.heap_free>mi.fordblks ? stats.heap_free-mi.fordblks : 0;
+    stats.samples++;
+
+    for (int i=0; i<tasks; i++) task_hwm[i].alive=false;
+#if configUSE_TRACE_FACILITY
+    TaskStatus_t *list;
+    int n=stats_tasks(&list);
+    for (int i=0; i<n; i++) note(list[i].pcTaskName, list[i].usStackHighWaterMark, list[i].uxCurrentPriority);
+#else
+    note(pcTaskGetName(NULL), uxTaskGetStackHighWaterMark(NULL), 0);
+#endif
+}
+
+void stats_report(int part) {
+    int per=(STATS_TASKS+STATS_PARTS-1)/STATS_PARTS, end=(part+1)*per<tasks ? (part+1)*per : tasks;
+    if (!part) {
+        LOG_I("heap free=%u min=%u top=%u frag=%u after %d samples\n",
+                stats.heap_free, stats.heap_min, stats.heap_top, stats.heap_frag, stats.samples);
+        if (stats.tasks_missed) LOG_E("stack report incomplete: %d tasks, raise STATS_TASKS\n", stats.tasks_missed);
+        stats.tasks_missed=0; //the next sample sets it again while there are still too many
+    }
+    for (int i=part*per; i<end; i++) {
+        int spare=task_hwm[i].hwm-STATS_MARGIN;
+        LOG_I("stack %-16s prio=%2d min free=%4d words%s -> %s by %d words\n", task_hwm[i].name, task_hwm[i].prio,
+                task_hwm[i].hwm, task_hwm[i].alive?"":" (ended)", spare>=0?"can shrink":"TOO SMALL, grow", spare>=0?spare:-spare);
+    }
+}
@@ -0,0 +1,39 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Stack and heap high water marks
+ *  call stats_sample periodically, the lowest values seen since boot are kept
+ *  stats_report(part) sends part of a sizing report through the log sink, call it for 0 to STATS_PARTS-1
+ *  needs configUSE_TRACE_FACILITY=1 to see all tasks, otherwise only the calling task is sampled
+ *  stats_tasks gives the task list to the scheduler jobs that need it (stats, trace and profile names), one static
+ *  array for all, so only call it from a scheduler job
+ */
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stdint.h>
+#include <FreeRTOS.h>
+#include <task.h>
+
+#define STATS_TASKS   24 //esp-open-rtos, HomeKit and the application together come close to 16
+#define STATS_MARGIN  64 //words of stack we want to keep as margin in the sizing report
+#define STATS_PARTS    3 //the report comes in parts of STATS_TASKS/STATS_PARTS stack lines, each fits LOG_RING
+
+typedef struct stats {
+    uint32_t heap_free; //bytes free now
+    uint32_t heap_min;  //lowest heap_free since boot
+    uint32_t heap_top;  //untouched top of the heap, the largest block we are sure to get
+    uint32_t heap_frag; //free bytes scattered inside the used part of the heap
+    int      stack_min; //lowest stack high water mark of all tasks, in words
+    char     stack_min_task[16];
+    int      samples;
+    int      tasks_missed; //tasks when there were more than STATS_TASKS, the list was empty then
+} stats_t;
+
+extern stats_t stats;
+
+void stats_sample(void);
+void stats_report(int part);
+#if configUSE_TRACE_FACILITY
+int  stats_tasks(TaskStatus_t **list); //number of tasks in list, 0 if there are more than STATS_TASKS
+#endif
+
+#endif // __STATS_H__
@@ -0,0 +1,28 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Single producer single consumer ring, also compiles on a host for tools/ctrlbench
+ */
+#include "telemetry.h"
+
+static telemetry_t ring[TELEMETRY_RING];
+static uint32_t head=0, tail=0; //free running
+
+uint32_t telemetry_dropped=0;
+
+bool telemetry_push(const telemetry_t *record) {
+    uint32_t h=head; //only we write head
+    if (h-__atomic_load_n(&tail, __ATOMIC_ACQUIRE)>=TELEMETRY_RING) {
+        telemetry_dropped++;
+        return false;
+    }
+    ring[h%TELEMETRY_RING]=*record;
+    __atomic_store_n(&head, h+1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool telemetry_pop(telemetry_t *record) {
+    uint32_t t=tail; //only we write tail
+    if (t==__atomic_load_n(&head, __ATOMIC_ACQUIRE)) return false;
+    *record=ring[t%TELEMETRY_RING];
+    __atomic_store_n(&tail, t+1, __ATOMIC_RELEASE);
+    return true;
+}
@@ -0,0 +1,28 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Single producer single consumer ring between the control loop and the publisher task
+ *  the control loop only pushes a fixed size record, so its timing does not depend on MQTT, HomeKit or logging
+ *  no locks: the producer only writes head, the consumer only writes tail
+ */
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TELEMETRY_RING 8 //records, power of 2
+
+typedef struct telemetry {
+    uint32_t   ms;         //time of the decision
+    const char *event;     //NULL for a beat, else what caused an immediate decision
+    float      t_in, t_out;
+    float      delta_out, delta_sum;
+    int        inhibit;    //seconds left
+    uint8_t    on, inhibited, timed, delta_ready;
+} telemetry_t;
+
+extern uint32_t telemetry_dropped; //records lost because the consumer fell behind
+
+bool telemetry_push(const telemetry_t *record); //producer side, never blocks
+bool telemetry_pop(telemetry_t *record);        //consumer side, false if empty
+
+#endif // __TELEMETRY_H__
@@ -0,0 +1,105 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Turns the BLOG_BINARY records of the pumpswitch back into text
+ *  blogdecode            listens on UDP port BLOG_PORT
+ *  blogdecode file...    decodes captured records (concatenated raw datagrams)
+ *  tools/blogtest includes this file with BLOGDECODE_LIB for the round trip against blog.c
+ *  build with: make blogdecode
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "../blog.h"
+
+#define BLOG_FMT(id, level, sig, fmt) {#id, sig, fmt},
+static const struct {const char *name, *sig, *fmt;} table[]={
+#include "../blog-formats.def"
+};
+#undef BLOG_FMT
+
+static uint32_t get32(const uint8_t *p) {
+    return p[0] | p[1]<<8 | p[2]<<16 | (uint32_t)p[3]<<24;
+}
+
+//print one record, returns its length or 0 if it is malformed
+static int decode(const uint8_t *rec, int avail, const char *from) {
+    int id=rec[0], len=rec[1], n=BLOG_HEADER;
+    const char *sig, *f;
+    char spec[16], str[BLOG_RECORD];
+    union {float f; uint32_t u;} v;
+
+    if (avail<BLOG_HEADER || len<BLOG_HEADER || len>avail || id>=BLOG_FORMATS) return 0;
+    printf("%s%10.3f ", from, get32(rec+2)/1000.0);
+    for (f=table[id].fmt, sig=table[id].sig; *f; f++) {
+        if (*f!='%' || f[1]=='%') { //plain text
+            if (*f=='%') f++;
+            putchar(*f);
+            continue;
+        }
+        int k=0;
+        while (k<(int)sizeof(spec)-2 && !strchr("diufFeEgGxXcs",*f)) spec[k++]=*f++;
+        spec[k++]=*f; spec[k]=0;
+        if (!*sig) {fputs(spec,stdout); continue;} //more conversions than arguments
+        if (*sig=='s') {
+            int l=n<len ? rec[n] : 0;
+            if (n+1+l>len) l=len>n+1 ? len-n-1 : 0;
+            memcpy(str,rec+n+1,l); str[l]=0;
+            printf(spec,str);
+            n+=1+l;
+        } else if (n+4<=len) {
+            v.u=get32(rec+n); n+=4;
+            if (*sig=='f') printf(spec,v.f);
+            else if (*sig=='u') printf(spec,v.u);
+            else printf(spec,(int)v.u);
+        }
+        sig++;
+    }
+    return len;
+}
+
+#ifndef BLOGDECODE_LIB //tools/blogtest uses decode
+static void decode_all(const uint8_t *buf, long size, const char *from) {
+    long n, pos=0;
+    while (pos<size && (n=decode(buf+pos,size-pos,from))) pos+=n;
+    if (pos<size) fprintf(stderr,"%ld bytes could not be decoded\n",size-pos);
+}
+
+int main(int argc, char *argv[]) {
+    uint8_t buf[65536];
+    
+    if (argc>1) {
+        for (int i=1; i<argc; i++) {
+            FILE *fp=fopen(argv[i],"rb");
+            if (!fp) {perror(argv[i]); return 1;}
+            fseek(fp,0,SEEK_END);
+            long size=ftell(fp);
+            uint8_t *file=malloc(size);
+            rewind(fp);
+            if (!file || fread(file,1,size,fp)!=(size_t)size) {perror(argv[i]); return 1;}
+            decode_all(file,size,"");
+            free(file);
+            fclose(fp);
+        }
+        return 0;
+    }
+
+    struct sockaddr_in addr={0}, from;
+    socklen_t fromlen;
+    int sock=socket(AF_INET, SOCK_DGRAM, 0), n;
+    addr.sin_family=AF_INET;
+    addr.sin_port=htons(BLOG_PORT);
+    addr.sin_addr.s_addr=htonl(INADDR_ANY);
+    if (sock<0 || bind(sock,(struct sockaddr*)&addr,sizeof(addr))) {perror("bind"); return 1;}
+    while (1) {
+        fromlen=sizeof(from);
+        if ((n=recvfrom(sock,buf,sizeof(buf),0,(struct sockaddr*)&from,&fromlen))<=0) continue;
+        char ip[32];
+        snprintf(ip,sizeof(ip),"%s ",inet_ntoa(from.sin_addr));
+        decode_all(buf,n,ip);
+        fflush(stdout);
+    }
+}
+#endif //BLOGDECODE_LIB
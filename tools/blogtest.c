@@ -0,0 +1,93 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Round trip of the BLOG records: blog.c compiled with BLOG_BINARY encodes, tools/blogdecode.c decodes, and
+ *  the text must be what the format gives with printf on the same arguments, for every entry of blog-formats.def
+ *  also checks the timestamp and that a string too long for BLOG_RECORD is cut and not the record
+ *  build and run with: make blogtest
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "FreeRTOS.h" //tools/posix
+#include "../logsink.h"
+#include "../blog.h"
+
+static FILE    *out; //the decoder prints into this
+static char    *text;
+static size_t  text_len;
+#define printf(...)  fprintf(out, __VA_ARGS__)
+#define putchar(c)   fputc(c, out)
+#undef  stdout
+#define stdout       out
+#define BLOGDECODE_LIB
+#include "blogdecode.c"
+#undef printf
+#undef putchar
+#undef stdout
+#define stdout stdout
+
+_Static_assert(BLOG_FORMATS==6, "a new format in blog-formats.def needs its round trip in main");
+
+static uint8_t  rec[BLOG_RECORD];
+static int      rec_len, failed, cases;
+static uint32_t now;
+
+TickType_t xTaskGetTickCount(void) {return now;}
+
+int log_put(int level, int kind, const void *data, int len) {
+    if (kind!=LOG_BINARY || len>BLOG_RECORD) {rec_len=-1; return -1;}
+    memcpy(rec, data, len);
+    rec_len=len;
+    return 0;
+}
+
+static void check(const char *name, const char *expect) { //the record of the last blog() against printf
+    char line[512];
+    cases++;
+    out=open_memstream(&text, &text_len);
+    int n=rec_len>0 ? decode(rec, rec_len, "") : 0;
+    fclose(out);
+    snprintf(line, sizeof(line), "%10.3f %s", now/1000.0, expect);
+    if (n!=rec_len || strcmp(text, line)) {
+        failed++;
+        fprintf(stderr, "FAIL %s: record of %d bytes, decoded %d\n  expect: %s  got:    %s", name, rec_len, n, line, text);
+    }
+    free(text);
+}
+
+#define ROUND_TRIP(id, fmt, ...) do { \
+    char expect[512]; \
+    snprintf(expect, sizeof(expect), fmt, ##__VA_ARGS__); \
+    BLOG(id, ##__VA_ARGS__); \
+    check(#id, expect); \
+} while (0)
+
+int main(void) {
+    static const float temps[]={0, 21.5F, -10.0625F, 99.99F, 125, -55, 3.14159F};
+    static const char *tails[]={"", " inhibited for another 900 seconds", " TIMER activated"};
+    char long_str[3*BLOG_RECORD];
+
+    for (int i=0; i<7; i++) for (int j=0; j<3; j++) {
+        now=i*100003U+j*7;
+        ROUND_TRIP(BEAT, "R%2.3f - %2.3f C => %d%s\n", temps[i], temps[6-i], j&1, tails[j]);
+        ROUND_TRIP(DELTA, "Delta-out= %2.3f\n", temps[i]);
+        ROUND_TRIP(EVENT, "%s => %d%s\n", "HomeKit", j&1, tails[j]);
+    }
+    now=UINT32_MAX-999; //the uptime counter wraps after 49 days
+    ROUND_TRIP(PING_GOOD, "good ping from %s %u ms -> count: %d s\n", "192.168.178.1", 4000000000U, -1);
+    ROUND_TRIP(PING_FAIL, "failed ping err %d -> count: %d s\n", -3, 120);
+    ROUND_TRIP(MQTT_FAIL, "MQTT publish of %s failed because %s\n", "tIN", "queue full");
+
+    memset(long_str, 'x', sizeof(long_str)-1); long_str[sizeof(long_str)-1]=0; //cut to what is left of the record
+    BLOG(MQTT_FAIL, "tOUT", long_str);
+    char cut[BLOG_RECORD];
+    int  room=BLOG_RECORD-BLOG_HEADER-1-4-1; //after the first string "tOUT" and its length byte
+    memset(cut, 'x', room); cut[room]=0;
+    char expect[512];
+    snprintf(expect, sizeof(expect), "MQTT publish of %s failed because %s\n", "tOUT", cut);
+    check("MQTT_FAIL cut", expect);
+    if (rec_len!=BLOG_RECORD) {failed++; fprintf(stderr, "FAIL MQTT_FAIL cut: record of %d bytes\n", rec_len);}
+
+    printf("%s %d round trips of %d formats, %d failed\n", failed ? "FAIL" : "ok", cases, BLOG_FORMATS, failed);
+    return failed!=0;
+}
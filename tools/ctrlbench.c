@@ -0,0 +1,93 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Host benchmark of the control step: control_beat plus the telemetry push, as done in state_job
+ *  runs it while the consumer side is stalled (never pops), slow (sleeps per record) and keeping up
+ *  and prints the distribution of the step time, which must not depend on the consumer
+ *  fails when p99.99 or max exceed their limit: a push that waited for the slow consumer takes 200 us, one that
+ *  waited for the stalled one never returns, the limits sit above what host scheduling alone adds
+ *  only the consumer thread pops, between runs it empties the ring on request as the publisher would
+ *  build and run with: make ctrlbench
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "../control.h"
+#include "../telemetry.h"
+
+#define STEPS 200000
+#define LIMIT_P9999   50000 //ns
+#define LIMIT_MAX  20000000 //ns, a host time slice on a single CPU with the consumer thread is 4 ms
+
+enum {STALLED, SLOW, DRAINING, EMPTY};
+
+static const control_param_t param={21.5F,1.0F,10,10800,120};
+static volatile int consumer_mode, emptied, stop;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000u+ts.tv_nsec;
+}
+
+static void *consumer(void *arg) {
+    (void)arg;
+    telemetry_t tel;
+    while (!stop) {
+        if (consumer_mode==STALLED) {usleep(1000); continue;} //network is gone
+        if (consumer_mode==EMPTY) {
+            while (telemetry_pop(&tel));
+            consumer_mode=STALLED;
+            emptied=1;
+            continue;
+        }
+        if (telemetry_pop(&tel) && consumer_mode==SLOW) usleep(200); //every publish blocks
+    }
+    return NULL;
+}
+
+static int cmp(const void *a, const void *b) {
+    uint32_t x=*(const uint32_t*)a, y=*(const uint32_t*)b;
+    return x<y ? -1 : x>y;
+}
+
+static int run(const char *name, int mode) {
+    static uint32_t step_ns[STEPS];
+    control_t ctrl;
+    telemetry_t tel={0};
+    uint32_t dropped=telemetry_dropped;
+    
+    consumer_mode=mode;
+    control_init(&ctrl, &param);
+    for (int i=0; i<STEPS; i++) {
+        float t_in =21.5F+2.0F*sinf(i/50.0F), t_out=30.0F+sinf(i/70.0F);
+        uint64_t start=now_ns();
+        control_beat(&ctrl, i%997 ? t_in : NAN, t_out, (i/300)%5==0);
+        tel.ms=i; tel.t_in=ctrl.t_in; tel.t_out=ctrl.t_out; tel.on=ctrl.on; tel.delta_ready=ctrl.delta_ready;
+        telemetry_push(&tel);
+        step_ns[i]=now_ns()-start;
+    }
+    qsort(step_ns, STEPS, sizeof(step_ns[0]), cmp);
+    int fail=step_ns[STEPS-STEPS/10000]>LIMIT_P9999 || step_ns[STEPS-1]>LIMIT_MAX;
+    printf("%-9s min=%5uns median=%5uns p99=%5uns p99.99=%6uns max=%8uns dropped=%u%s\n", name, step_ns[0],
+            step_ns[STEPS/2], step_ns[STEPS*99/100], step_ns[STEPS-STEPS/10000], step_ns[STEPS-1],
+            telemetry_dropped-dropped, fail ? " FAIL" : "");
+    emptied=0; //the consumer empties the ring for the next run
+    consumer_mode=EMPTY;
+    while (!emptied) usleep(100);
+    return fail;
+}
+
+int main(void) {
+    pthread_t thread;
+    int       failed=0;
+    pthread_create(&thread, NULL, consumer, NULL);
+    failed+=run("stalled", STALLED);
+    failed+=run("slow",    SLOW);
+    failed+=run("draining",DRAINING);
+    stop=1;
+    pthread_join(thread, NULL);
+    printf("%s p99.99 limit %u ns, max limit %u ns\n", failed ? "FAIL" : "ok", LIMIT_P9999, LIMIT_MAX);
+    return failed!=0;
+}
@@ -0,0 +1,232 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Makes delta OTA images for the streaming patcher in delta.c and tests them on an emulated flash
+ *  delta [-i] old.bin new.bin patch      writes the patch
+ *  delta -t [-i] old.bin new.bin         round trip: applies the patch with delta.c, in random chunks like a download,
+ *                                        checks the result and reports patch size, apply time and sectors written
+ *  -i makes a patch that can be applied in place (old and new in the same flash area): it never takes old bytes
+ *     from a sector that the patcher has already rewritten, the round trip then applies it in place
+ *  matching is bsdiff style: a 16 byte seed found through a hash of the old image is extended while at least
+ *  3 out of 4 bytes are equal, the differences go into an ADD op which is cheap when they are sparse
+ *  the round trip also checks the sha384 of the new image on the fly, as the OTA does with verify.c
+ *  build with: make delta
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#define DELTA_HOST
+#define VERIFY_HOST
+#include "../delta.c"
+#include "../verify.c"
+
+#define SEED       16 //bytes that must match exactly to start a match
+#define HASH_BITS  20
+#define CHAIN      16 //candidates tried per position
+#define FLASH_SIZE 0x200000
+#define NEW_BASE   0x100000
+
+static uint8_t *old, *new, *out;
+static long     old_len, new_len, out_len, out_size;
+static bool     in_place;
+
+static void emit(const void *data, long len) {
+    if (out_len+len>out_size) out=realloc(out, out_size=2*(out_len+len)+4096);
+    memcpy(out+out_len, data, len);
+    out_len+=len;
+}
+
+static void emit_byte(uint8_t b) {emit(&b,1);}
+
+static void emit_varint(uint32_t v) {
+    while (v>=0x80) {emit_byte(v|0x80); v>>=7;}
+    emit_byte(v);
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    p[0]=v; p[1]=v>>8; p[2]=v>>16; p[3]=v>>24;
+}
+
+static uint32_t hash(const uint8_t *p) {
+    uint32_t h=0;
+    for (int k=0; k<SEED; k++) h=(h^p[k])*0x01000193;
+    return h>>(32-HASH_BITS);
+}
+
+static bool allowed(long i, long j) { //in place the sector of new position i is the oldest one not yet rewritten
+    return !in_place || j>=(i&~(long)(DELTA_SECTOR-1));
+}
+
+static long extend(long i, long j) { //length of the approximate match, it always ends on an equal byte
+    long k, best_k=0, score=0, best=0;
+    for (k=0; i+k<new_len && j+k<old_len && allowed(i+k,j+k); k++) {
+        if (new[i+k]==old[j+k]) {
+            if (++score>best) {best=score; best_k=k+1;}
+        } else if ((score-=3)<best-3*SEED) break;
+    }
+    return best_k;
+}
+
+static void emit_data(long from, long to) {
+    if (to<=from) return;
+    emit_byte(DELTA_DATA); emit_varint(to-from);
+    emit(new+from, to-from);
+}
+
+static void emit_match(long i, long j, long len) {
+    long k=0, z, r;
+    if (!memcmp(new+i, old+j, len)) {
+        emit_byte(DELTA_COPY); emit_varint(j); emit_varint(len);
+        return;
+    }
+    emit_byte(DELTA_ADD); emit_varint(j); emit_varint(len);
+    while (k<len) {
+        for (z=0; k+z<len && new[i+k+z]==old[j+k+z]; z++);
+        emit_varint(z); k+=z;
+        if (k==len) break;
+        for (r=0; k+r<len; r++) { //a gap of up to 2 equal bytes is cheaper inside the run than a new run
+            if (new[i+k+r]!=old[j+k+r]) continue;
+            long gap=0;
+            while (gap<3 && k+r+gap<len && new[i+k+r+gap]==old[j+k+r+gap]) gap++;
+            if (gap==3 || k+r+gap==len) break;
+            r+=gap-1;
+        }
+        emit_varint(r);
+        for (long n=0; n<r; n++) emit_byte(new[i+k+n]-old[j+k+n]);
+        k+=r;
+    }
+}
+
+static void make_patch(void) {
+    int32_t *head=malloc(sizeof(int32_t)<<HASH_BITS), *next=malloc(sizeof(int32_t)*(old_len+1));
+    long i=0, literal=0, diagonal=0;
+    uint8_t header[DELTA_HEADER];
+
+    memset(head, -1, sizeof(int32_t)<<HASH_BITS);
+    for (long j=old_len-SEED; j>=0; j--) { //chains run from low to high offsets
+        uint32_t h=hash(old+j);
+        next[j]=head[h]; head[h]=j;
+    }
+    out_len=0;
+    put32(header, DELTA_MAGIC); put32(header+4, old_len); put32(header+8, new_len);
+    put32(header+12, delta_crc32(0, old, old_len));
+    emit(header, DELTA_HEADER);
+    while (i+SEED<=new_len) {
+        long best_len=0, best_j=0, len, j=i+diagonal;
+        if (j>=0 && j<old_len && allowed(i,j) && (len=extend(i,j))>=SEED) {best_len=len; best_j=j;} //code after an insertion
+        int tries=CHAIN;
+        for (j=head[hash(new+i)]; j>=0 && tries--; j=next[j]) {
+            if (!allowed(i,j) || memcmp(new+i, old+j, SEED)) continue;
+            if ((len=extend(i,j))>best_len) {best_len=len; best_j=j;}
+        }
+        if (best_len<SEED) {i++; continue;}
+        emit_data(literal, i);
+        emit_match(i, best_j, best_len);
+        diagonal=best_j-i;
+        i+=best_len;
+        literal=i;
+    }
+    emit_data(literal, new_len);
+    emit_byte(DELTA_END);
+    free(head); free(next);
+}
+
+static uint8_t *flash;
+static long     erases;
+
+bool delta_flash_read(uint32_t addr, uint8_t *buf, uint32_t size) {
+    if (addr+size>FLASH_SIZE) return false;
+    memcpy(buf, flash+addr, size);
+    return true;
+}
+
+bool delta_flash_write(uint32_t addr, const uint8_t *buf, uint32_t size) { //NOR flash only clears bits
+    if (addr+size>FLASH_SIZE || (addr&3) || (size&3)) return false;
+    for (uint32_t k=0; k<size; k++) flash[addr+k]&=buf[k];
+    return true;
+}
+
+bool delta_flash_erase(uint32_t addr) {
+    if (addr>=FLASH_SIZE || (addr&(DELTA_SECTOR-1))) return false;
+    memset(flash+addr, 0xff, DELTA_SECTOR);
+    erases++;
+    return true;
+}
+
+static uint8_t *load(const char *name, long *len) {
+    FILE *f=fopen(name,"rb");
+    uint8_t *data;
+    if (!f) {perror(name); exit(2);}
+    fseek(f, 0, SEEK_END); *len=ftell(f); rewind(f);
+    data=malloc(*len+1);
+    if (fread(data, 1, *len, f)!=(size_t)*len) {perror(name); exit(2);}
+    fclose(f);
+    if (*len>NEW_BASE) {fprintf(stderr, "%s is larger than %d bytes\n", name, NEW_BASE); exit(2);}
+    return data;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+static int round_trip(void) {
+    static delta_t d;
+    verify_t v;
+    uint8_t  sig[VERIFY_SIG_LEN];
+    uint32_t new_base=in_place ? 0 : NEW_BASE;
+    long     fed=0, chunks=0;
+    int      result=DELTA_MORE, len;
+    double   start;
+
+    flash=malloc(FLASH_SIZE);
+    memset(flash, 0xff, FLASH_SIZE);
+    memcpy(flash, old, old_len);
+    srand(old_len^new_len);
+    SHA384(new, new_len, sig); //what make sig puts in main.bin.sig
+    sig[48]=new_len>>24; sig[49]=new_len>>16; sig[50]=new_len>>8; sig[51]=new_len;
+    start=now();
+    verify_init(&v, sig, sizeof(sig));
+    delta_init(&d, 0, new_base, NEW_BASE);
+    d.verify=&v;
+    while (fed<out_len && result==DELTA_MORE) {
+        int chunk=1+rand()%1460; //like TLS records and TCP segments
+        if (chunk>out_len-fed) chunk=out_len-fed;
+        result=delta_feed(&d, out+fed, chunk);
+        fed+=chunk; chunks++;
+    }
+    len=delta_finish(&d);
+    double apply=now()-start;
+    if (len<0) {printf("FAIL apply error %d\n", len); return 1;}
+    if (verify_final(&v)) {printf("FAIL sha384 of the flushed sectors does not match\n"); return 1;}
+    if (len!=new_len || memcmp(flash+new_base, new, new_len)) {printf("FAIL result differs from the new image\n"); return 1;}
+    printf("ok %s old=%ld new=%ld patch=%ld (%.1f%% of new) applied in %.1f ms from %ld chunks, "
+           "sectors written %u skipped %u, patcher RAM %zu bytes\n", in_place ? "in place" : "separate",
+           old_len, new_len, out_len, 100.0*out_len/new_len, apply*1000, chunks, d.erased, d.skipped, sizeof(d));
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    bool test=false;
+    int  a=1;
+    for (; a<argc && argv[a][0]=='-'; a++) {
+        if (!strcmp(argv[a],"-t")) test=true;
+        else if (!strcmp(argv[a],"-i")) in_place=true;
+        else break;
+    }
+    if (argc-a!=(test ? 2 : 3)) {
+        fprintf(stderr, "usage: delta [-i] old.bin new.bin patch\n       delta -t [-i] old.bin new.bin\n");
+        return 2;
+    }
+    old=load(argv[a], &old_len);
+    new=load(argv[a+1], &new_len);
+    double start=now();
+    make_patch();
+    fprintf(stderr, "patch %ld bytes for %ld byte image, made in %.2f s\n", out_len, new_len, now()-start);
+    if (test) return round_trip();
+    FILE *f=fopen(argv[a+2],"wb");
+    if (!f || fwrite(out, 1, out_len, f)!=(size_t)out_len || fclose(f)) {perror(argv[a+2]); return 2;}
+    return 0;
+}
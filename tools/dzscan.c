@@ -0,0 +1,346 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Fleet health from archived captures of the Domoticz MQTT stream, e.g. mosquitto_sub -t domoticz/in -F '%U %p'
+ *  dzscan [-j threads] [-s setpoint] [-y hysteresis] [-r repeat] [-u run] capture...
+ *  a line holds {"idx":N,"nvalue":0,"svalue":"V"} as report.c publishes it, with an optional unix time in front
+ *  (seconds, fraction allowed); without it there are no durations, so no duty cycle and no stale check
+ *  the files are mapped and cut into segments, each segment into one chunk per thread at line ends; the threads
+ *  scan their chunk (SSE2 for the line ends, a fixed pattern for the JSON) into one bucket per shard, then every
+ *  thread rolls up its shard (idx modulo threads) from the buckets in file order, so each idx sees its samples in time
+ *  per idx: count, mean, min, max, gaps and a least squares slope per day; a device is a base idx with the channels
+ *  of channels.def at their ix, which also gives the tDELTA scale and the max_s of tIN for the stale check
+ *  sentinels (99.99 of a failed sensor, published as 100.0 before tBUS) only exist on tIN and tOUT, but which idx is
+ *  which channel is only known once all idx are in, so every idx is rolled up twice, with all samples and without
+ *  the sentinels, and the report takes the one that fits the channel: a tSTACK of 100 words is a value
+ *  duty cycle: the hysteresis of control.c on the reported tIN, held between reports, plus run seconds for every
+ *  repeat seconds off (the exercise timer), so an estimate: report.c only publishes changes beyond its deadband
+ *  flags: LOWDELTA last delta_sum below six times 0.1 C (the pump may be broken, see control.c), FALLING the delta
+ *  trend loses more than a quarter over the span, SENSOR sentinels in tIN or tOUT, STALE tIN silent for more than
+ *  twice its max_interval, STUCK tIN unchanged for a day, HEAP and STACK below their limits, BUS a minute with
+ *  as many failed sensor reads as beats
+ *  build and run with: make dzscan
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define SEGMENT    (64<<20) //bytes scanned before the rollups catch up, bounds the bucket memory
+#define MAX_THREADS 64
+#define NO_TIME    INT64_MIN
+#define SENTINEL   100.0F   //99.99 C published with %.1f
+#define STALE_MS   (2*channels[tIN].max_s*1000LL) //twice max_interval of tIN
+#define LOWDELTA   (0.6F*channels[tDELTA].scale)  //6 samples of 0.1 C, scaled like tDELTA
+#define HEAP_MIN   8192     //bytes
+#define STACK_MIN  64       //words
+#define BUS_MAX    6        //failed reads per minute, one per beat
+
+#define CHANNEL(name, ix, scale, db, min_s, max_s) name,
+enum {
+#include "channels.def"
+    CHANNEL_COUNT
+};
+#undef  CHANNEL
+#define CHANNEL(name, ix, scale, db, min_s, max_s) {ix, scale, max_s},
+static const struct {int ix; float scale; int max_s;} channels[]={ //as main.c publishes them
+#include "channels.def"
+};
+#undef  CHANNEL
+
+typedef struct sample {int64_t ms; uint32_t idx; float v;} sample_t;
+typedef struct bucket {sample_t *s; long n, max;} bucket_t;
+
+typedef struct stats {
+    bool     on;                   //hysteresis state, as if it were tIN
+    uint64_t n, gaps, changes;
+    float    last, min, max;
+    double   sum, sx, sy, sxx, sxy; //least squares over days (or samples without time)
+    int64_t  first_ms, last_ms, on_ms, seen_ms, off_ms, unchanged_since;
+} stats_t;
+
+typedef struct rollup {
+    uint32_t idx;
+    bool     used;
+    uint64_t sentinels;
+    stats_t  all, kept;            //kept: without the sentinels, for tIN and tOUT
+} rollup_t;
+
+typedef struct shard {rollup_t *r; long n, cap;} shard_t;
+
+static int      threads;
+static float    setpoint=21.5F, hysteresis=1.0F;
+static int      repeat=10800, run=120;
+static bucket_t bucket[MAX_THREADS][MAX_THREADS]; //[chunk][shard]
+static shard_t  shard[MAX_THREADS];
+static const char *chunk[MAX_THREADS+1];
+static uint64_t lines[MAX_THREADS], skipped[MAX_THREADS];
+
+static const char *find_nl(const char *p, const char *end) {
+#ifdef __SSE2__
+    const __m128i nl=_mm_set1_epi8('\n');
+    for (; p+16<=end; p+=16) {
+        int m=_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), nl));
+        if (m) return p+__builtin_ctz(m);
+    }
+#endif
+    p=memchr(p, '\n', end-p);
+    return p ? p : end;
+}
+
+static const char *number(const char *p, const char *end, double *v) { //digits, sign and fraction only
+    double x=0, f=1;
+    bool   neg=false, any=false;
+    if (p<end && *p=='-') {neg=true; p++;}
+    for (; p<end && *p>='0' && *p<='9'; p++, any=true) x=x*10+(*p-'0');
+    if (p<end && *p=='.') for (p++; p<end && *p>='0' && *p<='9'; p++, any=true) x+=(*p-'0')*(f/=10);
+    if (!any) return NULL;
+    *v=neg ? -x : x;
+    return p;
+}
+
+static bool parse(const char *p, const char *end, sample_t *s) { //one line
+    static const char idx_key[]="{\"idx\":", val_key[]="\"svalue\":\"";
+    const char *q;
+    double v, t;
+    s->ms=NO_TIME;
+    if (p<end && *p>='0' && *p<='9' && (q=number(p, end, &t)) && q<end && *q==' ') s->ms=(int64_t)(t*1000+0.5);
+    if (!(p=memchr(p, '{', end-p)) || end-p<8 || memcmp(p, idx_key, 7)) return false;
+    if (!(p=number(p+7, end, &v)) || v<0) return false;
+    s->idx=v;
+    if (end-p>=22 && !memcmp(p, ",\"nvalue\":0,\"svalue\":\"", 22)) p+=22; //the shape of report.c
+    else { //any other order or nvalue
+        for (q=p; q+10<=end && memcmp(q, val_key, 10); q++);
+        if (q+10>end) return false;
+        p=q+10;
+    }
+    if (!number(p, end, &v)) return false;
+    s->v=v;
+    return true;
+}
+
+static void add(bucket_t *b, const sample_t *s) {
+    if (b->n==b->max) {
+        b->max=b->max ? 2*b->max : 4096;
+        if (!(b->s=realloc(b->s, b->max*sizeof(sample_t)))) {perror("dzscan"); exit(2);}
+    }
+    b->s[b->n++]=*s;
+}
+
+static void *scan(void *arg) {
+    int c=(intptr_t)arg;
+    const char *p=chunk[c], *end=chunk[c+1], *e;
+    sample_t s;
+    for (; p<end; p=e+1) {
+        e=find_nl(p, end);
+        lines[c]++;
+        if (parse(p, e, &s)) add(&bucket[c][s.idx%threads], &s);
+        else skipped[c]++;
+    }
+    return NULL;
+}
+
+static rollup_t *lookup(shard_t *sh, uint32_t idx) { //open addressing, grows at half full
+    if (2*(sh->n+1)>sh->cap) {
+        shard_t big={calloc(sh->cap ? 2*sh->cap : 1024, sizeof(rollup_t)), 0, sh->cap ? 2*sh->cap : 1024};
+        for (long i=0; i<sh->cap; i++) if (sh->r[i].used) *lookup(&big, sh->r[i].idx)=sh->r[i];
+        free(sh->r);
+        *sh=big;
+    }
+    long i=(idx*2654435761u)&(sh->cap-1);
+    while (sh->r[i].used && sh->r[i].idx!=idx) i=(i+1)&(sh->cap-1);
+    if (!sh->r[i].used) {
+        sh->r[i]=(rollup_t){.idx=idx, .used=true, .all={.min=INFINITY, .max=-INFINITY}, .kept={.min=INFINITY, .max=-INFINITY}};
+        sh->n++;
+    }
+    return sh->r+i;
+}
+
+static void add_stats(stats_t *r, const sample_t *s) {
+    bool timed=s->ms!=NO_TIME;
+    if (r->n) {
+        if (s->v!=r->last) {r->changes++; r->unchanged_since=s->ms;}
+        if (timed && r->last_ms!=NO_TIME) {
+            int64_t dt=s->ms-r->last_ms;
+            if (dt>STALE_MS) r->gaps++;
+            else { //the state since the previous report, as tIN held by the device
+                r->seen_ms+=dt;
+                if (r->on) r->on_ms+=dt; else r->off_ms+=dt;
+            }
+        }
+    } else {r->first_ms=r->unchanged_since=s->ms;}
+    if (s->v>setpoint+hysteresis/2 && !r->on) { //the off stretch had its exercise runs
+        r->on_ms+=r->off_ms/(repeat*1000LL)*run*1000LL;
+        r->off_ms=0;
+        r->on=true;
+    }
+    if (s->v<setpoint-hysteresis/2) r->on=false;
+    double x=timed ? (s->ms-r->first_ms)/86400000.0 : r->n;
+    r->n++; r->sum+=s->v; r->last=s->v; r->last_ms=s->ms;
+    if (s->v<r->min) r->min=s->v;
+    if (s->v>r->max) r->max=s->v;
+    r->sx+=x; r->sy+=s->v; r->sxx+=x*x; r->sxy+=x*s->v;
+}
+
+static void sample(rollup_t *r, const sample_t *s) {
+    add_stats(&r->all, s);
+    if (fabsf(s->v-SENTINEL)<0.05F) r->sentinels++; //control.c keeps its state on a broken input
+    else add_stats(&r->kept, s);
+}
+
+static void *roll(void *arg) {
+    int sh=(intptr_t)arg;
+    for (int c=0; c<threads; c++) { //chunks in file order
+        bucket_t *b=&bucket[c][sh];
+        for (long i=0; i<b->n; i++) sample(lookup(&shard[sh], b->s[i].idx), b->s+i);
+        b->n=0;
+    }
+    return NULL;
+}
+
+static void parallel(void *(*fn)(void*)) {
+    pthread_t tid[MAX_THREADS];
+    for (int t=0; t<threads; t++) pthread_create(tid+t, NULL, fn, (void*)(intptr_t)t);
+    for (int t=0; t<threads; t++) pthread_join(tid[t], NULL);
+}
+
+static uint64_t scan_file(const char *name) {
+    struct stat st;
+    int fd=open(name, O_RDONLY);
+    if (fd<0 || fstat(fd, &st)) {perror(name); exit(2);}
+    if (!S_ISREG(st.st_mode)) {fprintf(stderr, "%s: not a file, it is mapped\n", name); exit(2);}
+    if (!st.st_size) {close(fd); return 0;}
+    const char *map=mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0), *end=map+st.st_size;
+    if (map==MAP_FAILED) {perror(name); exit(2);}
+    madvise((void*)map, st.st_size, MADV_SEQUENTIAL);
+    for (const char *seg=map; seg<end; ) {
+        const char *seg_end=end-seg>SEGMENT ? find_nl(seg+SEGMENT, end) : end;
+        if (seg_end<end) seg_end++;
+        chunk[0]=seg;
+        for (int c=1; c<threads; c++) { //cut at the line end after the even split
+            const char *p=seg+(seg_end-seg)*c/threads;
+            if (p<chunk[c-1]) p=chunk[c-1];
+            p=find_nl(p, seg_end);
+            chunk[c]=p<seg_end ? p+1 : seg_end;
+        }
+        chunk[threads]=seg_end;
+        parallel(scan);
+        parallel(roll);
+        seg=seg_end;
+    }
+    munmap((void*)map, st.st_size);
+    close(fd);
+    return st.st_size;
+}
+
+static rollup_t *find(uint32_t idx) {
+    shard_t *sh=&shard[idx%threads];
+    if (!sh->cap) return NULL;
+    long i=(idx*2654435761u)&(sh->cap-1);
+    while (sh->r[i].used && sh->r[i].idx!=idx) i=(i+1)&(sh->cap-1);
+    return sh->r[i].used ? sh->r+i : NULL;
+}
+
+static stats_t *channel(uint32_t base, int c) { //the rollup that fits channel c of the device at base
+    rollup_t *r=find(base+channels[c].ix);
+    return !r ? NULL : c==tIN || c==tOUT ? &r->kept : &r->all;
+}
+
+static double slope(const stats_t *r) {
+    double d=r->n*r->sxx-r->sx*r->sx;
+    return r->n>1 && d>0 ? (r->n*r->sxy-r->sx*r->sy)/d : 0;
+}
+
+static int by_idx(const void *a, const void *b) {
+    uint32_t x=*(const uint32_t*)a, y=*(const uint32_t*)b;
+    return x<y ? -1 : x>y;
+}
+
+int main(int argc, char *argv[]) {
+    struct timespec t0, t1;
+    uint64_t bytes=0, n_lines=0, n_skipped=0, samples=0;
+    uint32_t *ids;
+    long     n_ids=0, devices=0, flagged=0, a, span=0;
+    double   secs;
+
+    threads=sysconf(_SC_NPROCESSORS_ONLN);
+    for (a=1; a+1<argc && argv[a][0]=='-'; a+=2) {
+        const char *v=argv[a+1];
+        switch (argv[a][1]) {
+            case 'j': threads=atoi(v); break;
+            case 's': setpoint=atof(v); break;
+            case 'y': hysteresis=atof(v); break;
+            case 'r': repeat=atoi(v); break;
+            case 'u': run=atoi(v); break;
+            default:  a=argc; break;
+        }
+    }
+    if (a>=argc) {
+        fprintf(stderr, "usage: dzscan [-j threads] [-s setpoint] [-y hysteresis] [-r repeat] [-u run] capture...\n");
+        return 2;
+    }
+    if (threads<1) threads=1;
+    if (threads>MAX_THREADS) threads=MAX_THREADS;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (; a<argc; a++) bytes+=scan_file(argv[a]);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    secs=t1.tv_sec-t0.tv_sec+(t1.tv_nsec-t0.tv_nsec)/1e9;
+
+    for (int t=0; t<threads; t++) {n_lines+=lines[t]; n_skipped+=skipped[t]; n_ids+=shard[t].n;}
+    ids=malloc((n_ids+1)*sizeof(uint32_t));
+    n_ids=0;
+    for (int t=0; t<threads; t++) for (long i=0; i<shard[t].cap; i++) if (shard[t].r[i].used) {
+        ids[n_ids++]=shard[t].r[i].idx;
+        samples+=shard[t].r[i].all.n;
+    }
+    qsort(ids, n_ids, sizeof(uint32_t), by_idx);
+    for (int c=0; c<CHANNEL_COUNT; c++) if (channels[c].ix>=span) span=channels[c].ix+1; //idx of one device
+
+    printf("%-6s %8s %6s %6s %7s %7s %7s %8s %6s %6s  %s\n", "idx", "samples", "days", "duty%", "tIN", "tOUT",
+            "delta", "delta/d", "heap", "stack", "flags");
+    for (long i=0, next=0; i<n_ids; i++) { //a base has tIN and tOUT and tDELTA or tHEAP at their ix
+        if (ids[i]<next) continue; //a channel of the previous device
+        stats_t *in=channel(ids[i], tIN), *out=channel(ids[i], tOUT), *delta=channel(ids[i], tDELTA),
+                *heap=channel(ids[i], tHEAP), *stack=channel(ids[i], tSTACK), *bus=channel(ids[i], tBUS);
+        char flags[64]="", duty[16]="-", days[16]="-";
+        if (!in || !out || (!delta && !heap)) continue;
+        uint64_t sentinels=find(ids[i]+channels[tIN].ix)->sentinels+find(ids[i]+channels[tOUT].ix)->sentinels;
+        next=ids[i]+span;
+        devices++;
+        if (in->seen_ms) {
+            int64_t on=in->on_ms+(in->on ? 0 : in->off_ms/(repeat*1000LL)*run*1000LL);
+            snprintf(duty, sizeof(duty), "%.1f", 100.0*on/in->seen_ms);
+        }
+        if (in->n && in->last_ms!=NO_TIME) snprintf(days, sizeof(days), "%.1f", (in->last_ms-in->first_ms)/86400000.0);
+        double d_slope=delta ? slope(delta) : 0, d_mean=delta && delta->n ? delta->sum/delta->n : 0;
+        double d_span=delta && delta->n>1 ? (delta->last_ms!=NO_TIME ? (delta->last_ms-delta->first_ms)/86400000.0 : delta->n) : 0;
+        if (delta && delta->n && delta->last<LOWDELTA) strcat(flags, " LOWDELTA");
+        if (delta && d_mean>0 && d_slope*d_span<-0.25*d_mean) strcat(flags, " FALLING");
+        if (sentinels) strcat(flags, " SENSOR");
+        if (in->gaps) strcat(flags, " STALE");
+        if (in->last_ms!=NO_TIME && in->last_ms-in->unchanged_since>86400000LL) strcat(flags, " STUCK");
+        if (heap && heap->n && heap->min<HEAP_MIN) strcat(flags, " HEAP");
+        if (stack && stack->n && stack->min<STACK_MIN) strcat(flags, " STACK");
+        if (bus && bus->n && bus->max>=BUS_MAX) strcat(flags, " BUS");
+        flagged+=!!flags[0];
+        printf("%-6u %8lu %6s %6s %7.2f %7.2f %7.2f %8.3f %6.0f %6.0f %s\n", ids[i],
+                (unsigned long)(in->n+out->n+(delta ? delta->n : 0)+(heap ? heap->n : 0)+(stack ? stack->n : 0)
+                +(bus ? bus->n : 0)), days, duty,
+                in->n ? in->sum/in->n : NAN, out->n ? out->sum/out->n : NAN, delta && delta->n ? delta->last : NAN,
+                d_slope, heap && heap->n ? heap->min : NAN, stack && stack->n ? stack->min : NAN, flags[0] ? flags+1 : "");
+    }
+    fprintf(stderr, "%.1f MB, %lu lines, %lu skipped, %lu samples, %ld idx, %ld devices, %ld flagged, "
+            "%.2f s on %d threads = %.0f MB/s\n", bytes/1e6, (unsigned long)n_lines, (unsigned long)n_skipped,
+            (unsigned long)samples, n_ids, devices, flagged, secs, threads, secs>0 ? bytes/1e6/secs : 0);
+    return 0;
+}
@@ -0,0 +1,504 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Fleet load simulator for the broker and Domoticz side: many virtual pumpswitches publishing to domoticz/in
+ *  fleetsim [-n devices] [-j processes] [-t seconds] [-x speedup] [-K storm_s,...] [-W wifi_s] [-R ramp_s]
+ *           [-u user -p pass] broker[:port]
+ *  every device runs the real report.c (deadband, min and max interval, heartbeat) through the POSIX shim in
+ *  tools/posix on a random walk of temperatures, with channels.def as main.c, every beat as publish_task does
+ *  the MQTT side is the mqtt_task loop of mqtt-client.c turned into a state machine: MQTT 3.1 with cleansession 0,
+ *  QoS1 publishes one at a time with a 5 s command timeout, the keepalive ping, a reconnect at once after a drop,
+ *  a backoff of 100 ms doubling to 12.8 s after a failed attempt, and a queue of MQTT_QUEUE_SIZE that is emptied on a drop
+ *  one process per core, each with one epoll loop over its share of the devices, so report.c keeps its statics per
+ *  process; they add their counters into shared memory and the parent prints a line per second
+ *  -K drops all connections at those seconds, like an access point reboot, the devices come back after a random
+ *  Wi-Fi reconnect of up to -W seconds; -R spreads the boot over that many seconds instead of all at once
+ *  -x runs the device clocks faster (beat, report intervals, keepalive) for more load from the same sockets
+ *  reports the ingest rate (PUBACKs), connects, failures and drops, latency percentiles from publish to PUBACK and
+ *  from the report call to PUBACK (including the queue), and per storm how long until half, 90% and all are back
+ *  build and run with: make fleetsim
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "mqtt-client.h"
+#include "report.h"
+#include "control.h"
+#include <task.h> //tools/posix
+
+#define QUEUE     MQTT_QUEUE_SIZE
+#define BEAT_MS   (BEAT*1000)
+#define TICK_MS   (REPORT_TICK*1000) //heartbeat and heap/stack in publish_task
+#define TIMEOUT   5000      //ms, command timeout of mqtt_client_new
+#define BACKOFF1   100      //ms
+#define STORMS      16
+#define SECONDS   3600
+#define HIST      2000      //latency buckets of 1%
+
+enum {S_BACKOFF, S_CONNECTING, S_CONNACK, S_IDLE, S_PUBACK};
+
+#define CHANNEL(name, ix, scale, db, min_s, max_s) name,
+enum {
+#include "channels.def"
+    CHANNEL_COUNT
+};
+#undef  CHANNEL
+#define CHANNEL(name, ix, scale, db, min_s, max_s) REPORT_CHANNEL(#name, ix, scale, db, min_s, max_s),
+static const report_t channels[]={
+#include "channels.def"
+};
+#undef  CHANNEL
+static const mqtt_config_t defaults=MQTT_DEFAULT_CONFIG; //msg_len and keepalive as the device runs them
+
+typedef struct device {
+    int      fd, state, backoff;
+    uint64_t due;                  //ms, of the backoff or the command timeout
+    uint64_t beat, tick;           //device clock ms of the next beat and report tick
+    uint64_t last_tx, ping;        //ms, ping is 0 if none outstanding
+    uint64_t sent, queued[QUEUE];  //us, publish in flight and enqueue times
+    char     q[QUEUE][MQTT_MSG_LEN];
+    int      head, count;
+    uint16_t id;
+    uint8_t  in[64], out[256];
+    int      in_n, out_n;
+    float    t_in, t_out;
+    int      idx;
+    report_t ch[CHANNEL_COUNT];
+} device_t;
+
+typedef struct shared { //counters of all processes, updated with atomics
+    uint64_t t0;
+    int      connected;
+    struct {uint32_t acked, connects, fails, drops, full, lost, timeouts;} sec[SECONDS];
+    uint32_t pub[HIST], e2e[HIST];
+} shared_t;
+
+static shared_t *sh;
+static device_t *dev, *cur;
+static int      n_dev, epfd, keepalive, seconds=120, storms[STORMS], n_storms, wifi=3, ramp;
+static double   speedup=1;
+static char     *user="", *pass="", client_prefix[8];
+static struct sockaddr_in broker;
+static uint64_t now, now_us; //since t0, real time
+
+#define ADD(field, v) __atomic_add_fetch(&(field), (v), __ATOMIC_RELAXED)
+#define SEC           sh->sec[now/1000<SECONDS ? now/1000 : SECONDS-1]
+
+static uint64_t clock_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000ULL+ts.tv_nsec/1000;
+}
+
+static void tick(void) {
+    now_us=clock_us()-sh->t0;
+    now=now_us/1000;
+}
+
+static uint64_t vnow(void) {return now*speedup;}
+
+//the shim side of report.c
+TickType_t xTaskGetTickCount(void) {return vnow();}
+void log_text(int level, const char *format, ...) {}
+void blog(int id, ...) {}
+
+int mqtt_client_publish(char *format, ...) { //same checks as mqtt-client.c, into the queue of cur
+    char msg[MQTT_MSG_LEN];
+    va_list args;
+    va_start(args, format);
+    int n=vsnprintf(msg, defaults.msg_len, format, args);
+    va_end(args);
+    if (n>=defaults.msg_len) return -2;
+    if (cur->count==QUEUE) {ADD(SEC.full, 1); return -1;}
+    int i=(cur->head+cur->count++)%QUEUE;
+    memcpy(cur->q[i], msg, n+1);
+    cur->queued[i]=now_us;
+    return n;
+}
+
+static int hist_bucket(uint64_t us) {
+    int b=us ? (int)(log((double)us)/log(1.01)) : 0;
+    return b<HIST ? b : HIST-1;
+}
+
+static void mqtt_send(device_t *d, const uint8_t *p, int n);
+
+static void drop(device_t *d, bool failed) {
+    if (d->fd>=0) close(d->fd);
+    d->fd=-1;
+    if (d->state>=S_IDLE) { //was connected
+        __atomic_sub_fetch(&sh->connected, 1, __ATOMIC_RELAXED);
+        ADD(SEC.drops, 1);
+        ADD(SEC.lost, d->count);
+        d->head=d->count=0; //xQueueReset
+    }
+    d->in_n=d->out_n=0; d->ping=0;
+    if (failed) { //vTaskDelay(backoff), then double it
+        ADD(SEC.fails, 1);
+        d->due=now+d->backoff;
+        if (d->backoff<BACKOFF1*128) d->backoff*=2;
+    } else d->due=now;
+    d->state=S_BACKOFF;
+}
+
+static void start_connect(device_t *d) {
+    struct epoll_event ev={EPOLLOUT};
+    int one=1;
+    d->fd=socket(AF_INET, SOCK_STREAM|SOCK_NONBLOCK, 0);
+    if (d->fd<0) {drop(d, true); return;}
+    setsockopt(d->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(d->fd, (struct sockaddr*)&broker, sizeof(broker))<0 && errno!=EINPROGRESS) {drop(d, true); return;}
+    ev.data.u64=(uint64_t)(d-dev)<<32 | d->fd; //an event of an earlier socket of the device is ignored
+    epoll_ctl(epfd, EPOLL_CTL_ADD, d->fd, &ev);
+    d->state=S_CONNECTING;
+    d->due=now+TIMEOUT;
+}
+
+static int put_len(uint8_t *p, int len) { //MQTT remaining length
+    int n=0;
+    do {p[n]=len%128; len/=128; if (len) p[n]|=128; n++;} while (len);
+    return n;
+}
+
+static int put_str(uint8_t *p, const char *s) {
+    int n=strlen(s);
+    p[0]=n>>8; p[1]=n; memcpy(p+2, s, n);
+    return n+2;
+}
+
+static void send_connect(device_t *d) { //as mqtt_connect with the data of mqtt_task
+    uint8_t body[200], pkt[210];
+    char    id[20];
+    int     n=0, h;
+    snprintf(id, sizeof(id), "MAC-%s%06X", client_prefix, (unsigned)(d-dev));
+    n+=put_str(body+n, "MQIsdp");
+    body[n++]=3;                                        //MQTTVersion 3
+    body[n++]=(*user ? 0x80 : 0) | (*pass ? 0x40 : 0);  //cleansession 0, no will
+    body[n++]=keepalive>>8; body[n++]=keepalive;
+    n+=put_str(body+n, id);
+    if (*user) n+=put_str(body+n, user);
+    if (*pass) n+=put_str(body+n, pass);
+    pkt[0]=0x10;
+    h=1+put_len(pkt+1, n);
+    memcpy(pkt+h, body, n);
+    mqtt_send(d, pkt, h+n);
+    d->state=S_CONNACK;
+    d->due=now+TIMEOUT;
+}
+
+static void send_publish(device_t *d) {
+    uint8_t pkt[MQTT_BUF_LEN]; //mqtt_client_init checks that a publish fits
+    const char *msg=d->q[d->head];
+    int n=2+strlen(defaults.topic)+2+strlen(msg), h;
+    pkt[0]=0x32; //QoS1
+    h=1+put_len(pkt+1, n);
+    h+=put_str(pkt+h, defaults.topic);
+    if (!++d->id) d->id=1;
+    pkt[h++]=d->id>>8; pkt[h++]=d->id;
+    memcpy(pkt+h, msg, strlen(msg));
+    mqtt_send(d, pkt, h+strlen(msg));
+    d->state=S_PUBACK;
+    d->sent=now_us;
+    d->due=now+TIMEOUT;
+}
+
+static void mqtt_send(device_t *d, const uint8_t *p, int n) {
+    int w=0;
+    if (!d->out_n && (w=write(d->fd, p, n))<0) {
+        if (errno!=EAGAIN) {drop(d, d->state<S_IDLE); return;}
+        w=0;
+    }
+    if (w==n) {d->last_tx=now; return;}
+    if (d->out_n+n-w>(int)sizeof(d->out)) {drop(d, d->state<S_IDLE); return;} //the broker stopped reading
+    memcpy(d->out+d->out_n, p+w, n-w);
+    d->out_n+=n-w;
+    d->last_tx=now;
+    struct epoll_event ev={EPOLLIN|EPOLLOUT, {.u64=(uint64_t)(d-dev)<<32 | d->fd}};
+    epoll_ctl(epfd, EPOLL_CTL_MOD, d->fd, &ev);
+}
+
+static void packet(device_t *d, const uint8_t *p, int n) {
+    switch (p[0]>>4) {
+        case 2: //CONNACK
+            if (d->state!=S_CONNACK) return;
+            if (n<4 || p[3]) {drop(d, true); return;}
+            d->state=S_IDLE;
+            d->backoff=BACKOFF1;
+            __atomic_add_fetch(&sh->connected, 1, __ATOMIC_RELAXED);
+            ADD(SEC.connects, 1);
+            return;
+        case 4: //PUBACK
+            if (d->state!=S_PUBACK || n<4 || (p[2]<<8|p[3])!=d->id) return;
+            ADD(SEC.acked, 1);
+            ADD(sh->pub[hist_bucket(now_us-d->sent)], 1);
+            ADD(sh->e2e[hist_bucket(now_us-d->queued[d->head])], 1);
+            d->head=(d->head+1)%QUEUE; d->count--;
+            d->state=S_IDLE;
+            return;
+        case 13: //PINGRESP
+            d->ping=0;
+            return;
+    }
+}
+
+static void readable(device_t *d) {
+    int n=read(d->fd, d->in+d->in_n, sizeof(d->in)-d->in_n);
+    if (n<=0) {
+        if (n<0 && errno==EAGAIN) return;
+        drop(d, d->state<S_IDLE);
+        return;
+    }
+    d->in_n+=n;
+    while (d->in_n>=2 && d->fd>=0) {
+        int len=0, mult=1, h=1;
+        do {len+=(d->in[h]&127)*mult; mult*=128;} while ((d->in[h++]&128) && h<d->in_n && h<5);
+        if (h+len>d->in_n) {
+            if (h+len>(int)sizeof(d->in)) drop(d, d->state<S_IDLE); //nothing this big is expected
+            return;
+        }
+        packet(d, d->in, h+len);
+        if (d->fd<0) return;
+        memmove(d->in, d->in+h+len, d->in_n-h-len);
+        d->in_n-=h+len;
+    }
+}
+
+static void writable(device_t *d) {
+    if (d->state==S_CONNECTING) {
+        int err=0;
+        socklen_t len=sizeof(err);
+        getsockopt(d->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err) {drop(d, true); return;}
+        struct epoll_event ev={EPOLLIN, {.u64=(uint64_t)(d-dev)<<32 | d->fd}};
+        epoll_ctl(epfd, EPOLL_CTL_MOD, d->fd, &ev);
+        send_connect(d);
+        return;
+    }
+    int w=write(d->fd, d->out, d->out_n);
+    if (w<0) {if (errno!=EAGAIN) drop(d, d->state<S_IDLE); return;}
+    memmove(d->out, d->out+w, d->out_n-w);
+    if (!(d->out_n-=w)) {
+        struct epoll_event ev={EPOLLIN, {.u64=(uint64_t)(d-dev)<<32 | d->fd}};
+        epoll_ctl(epfd, EPOLL_CTL_MOD, d->fd, &ev);
+    }
+}
+
+static float walk(float t) { //1/16 C steps, now and then a tap draw
+    int r=rand()%100;
+    if (r<15) t-=0.0625F; else if (r<30) t+=0.0625F; else if (r==99) t+=2+rand()%4;
+    return t<15 ? 15 : t>60 ? 60 : t;
+}
+
+static void device_job(device_t *d) { //state_job and publish_task of main.c on the device clock
+    uint64_t v=vnow();
+    cur=d;
+    report_init(d->ch, CHANNEL_COUNT, d->idx);
+    while (v>=d->beat) {
+        d->beat+=BEAT_MS;
+        d->t_in=walk(d->t_in); d->t_out=walk(d->t_out);
+        if (rand()%1080==0) report(&d->ch[tDELTA], (rand()%16)/16.0F); //a sampling ends about every 3 hours
+        report(&d->ch[tIN], d->t_in);
+        report(&d->ch[tOUT], d->t_out);
+    }
+    if (v>=d->tick) {
+        d->tick=v+TICK_MS;
+        report(&d->ch[tHEAP], 16000+rand()%2048);
+        report(&d->ch[tSTACK], 100+rand()%32);
+        report(&d->ch[tHEAPMIN], 14000+rand()%512);
+        report(&d->ch[tHEAPTOP], 8000+rand()%2048);
+        report(&d->ch[tBUS], rand()%60==0); //a failed sensor read about once an hour
+        report_heartbeat();
+    }
+}
+
+static void mqtt_job(device_t *d) { //mqtt_task: publish what is queued, one at a time, then the keepalive
+    switch (d->state) {
+        case S_BACKOFF:
+            if (now>=d->due) start_connect(d);
+            return;
+        case S_CONNECTING: case S_CONNACK:
+            if (now>=d->due) drop(d, true);
+            return;
+        case S_PUBACK:
+            if (now<d->due) return;
+            ADD(SEC.timeouts, 1); //mqtt_publish failed, the message is gone and the loop goes on
+            d->head=(d->head+1)%QUEUE; d->count--;
+            d->state=S_IDLE;
+            //fall through
+        case S_IDLE:
+            if (d->count) {send_publish(d); return;}
+            if (d->ping && now-d->ping>=keepalive*1000ULL) {drop(d, false); return;}
+            if (!d->ping && now-d->last_tx>=keepalive*1000ULL) {
+                static const uint8_t pingreq[2]={0xc0, 0};
+                mqtt_send(d, pingreq, 2);
+                d->ping=now;
+            }
+            return;
+    }
+}
+
+static void run(int first, int last) {
+    struct epoll_event ev[256];
+    int    storm=0;
+
+    epfd=epoll_create1(0);
+    srand(first+1);
+    for (int i=first; i<last; i++) {
+        device_t *d=dev+i;
+        d->fd=-1;
+        d->state=S_BACKOFF;
+        d->backoff=BACKOFF1;
+        d->due=ramp ? rand()%(ramp*1000) : 0;
+        d->beat=d->due*speedup+rand()%BEAT_MS; //the devices are not in step
+        d->tick=d->beat;
+        d->t_in=20+rand()%8; d->t_out=30+rand()%8;
+        d->idx=100+i*8;
+        memcpy(d->ch, channels, sizeof(channels));
+    }
+    for (tick(); now<seconds*1000ULL; ) {
+        int n=epoll_wait(epfd, ev, 256, 5);
+        tick();
+        for (int i=0; i<n; i++) {
+            device_t *d=dev+(ev[i].data.u64>>32);
+            if (d->fd<0 || d->fd!=(int)(uint32_t)ev[i].data.u64) continue;
+            if (ev[i].events&(EPOLLOUT|EPOLLERR|EPOLLHUP) && (d->state==S_CONNECTING || d->out_n)) writable(d);
+            if (d->fd>=0 && ev[i].events&(EPOLLIN|EPOLLERR|EPOLLHUP) && d->state!=S_CONNECTING) readable(d);
+        }
+        if (storm<n_storms && now>=storms[storm]*1000ULL) { //access point reboot: all drop, Wi-Fi takes a while
+            for (int i=first; i<last; i++) {
+                device_t *d=dev+i;
+                if (d->fd>=0 || d->state!=S_BACKOFF) drop(d, false);
+                d->due=now+(wifi ? rand()%(wifi*1000) : 0);
+            }
+            storm++;
+        }
+        for (int i=first; i<last; i++) {
+            device_job(dev+i);
+            mqtt_job(dev+i);
+        }
+    }
+    for (int i=first; i<last; i++) if (dev[i].fd>=0) close(dev[i].fd);
+}
+
+static double percentile(const uint32_t *h, double p) {
+    uint64_t total=0, sum=0;
+    for (int i=0; i<HIST; i++) total+=h[i];
+    for (int i=0; i<HIST; i++) if ((sum+=h[i])>=total*p && total) return pow(1.01, i+1)/1000.0; //us buckets, in ms
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    struct rlimit rl;
+    struct hostent *he;
+    char   *host, *colon;
+    int    procs=sysconf(_SC_NPROCESSORS_ONLN), a, port=1883;
+    double at[STORMS+1][3]; //time to 50, 90 and 100% connected per storm, boot is the first
+    int    next=0;
+    uint64_t acked=0, peak=0, fails=0, drops=0, full=0, lost=0, timeouts=0, connects=0;
+
+    n_dev=100;
+    for (a=1; a+1<argc && argv[a][0]=='-'; a+=2) {
+        const char *v=argv[a+1];
+        switch (argv[a][1]) {
+            case 'n': n_dev=atoi(v); break;
+            case 'j': procs=atoi(v); break;
+            case 't': seconds=atoi(v); break;
+            case 'x': speedup=atof(v); break;
+            case 'W': wifi=atoi(v); break;
+            case 'R': ramp=atoi(v); break;
+            case 'u': user=argv[a+1]; break;
+            case 'p': pass=argv[a+1]; break;
+            case 'K':
+                for (const char *p=v; p && n_storms<STORMS; p=strchr(p, ',')) storms[n_storms++]=atoi(*p==',' ? ++p : p);
+                break;
+            default: a=argc; break;
+        }
+    }
+    if (a>=argc || n_dev<1 || seconds<1 || seconds>SECONDS || speedup<=0) {
+        fprintf(stderr, "usage: fleetsim [-n devices] [-j processes] [-t seconds] [-x speedup] [-K storm_s,...] [-W wifi_s] [-R ramp_s]\n"
+                        "                [-u user -p pass] broker[:port]\n");
+        return 2;
+    }
+    host=argv[a];
+    if ((colon=strchr(host, ':'))) {*colon=0; port=atoi(colon+1);}
+    if (!(he=gethostbyname(host))) {fprintf(stderr, "%s: unknown host\n", host); return 2;}
+    broker=(struct sockaddr_in){.sin_family=AF_INET, .sin_port=htons(port)};
+    memcpy(&broker.sin_addr, he->h_addr_list[0], sizeof(broker.sin_addr));
+    keepalive=defaults.keepalive/speedup<1 ? 1 : (int)(defaults.keepalive/speedup); //on the device clock
+    snprintf(client_prefix, sizeof(client_prefix), "%06X", (unsigned)getpid()&0xffffff);
+    if (procs<1) procs=1;
+    if (procs>n_dev) procs=n_dev;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur=rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    if ((rlim_t)n_dev/procs+16>rl.rlim_cur) fprintf(stderr, "warning: %lu file descriptors per process\n", (unsigned long)rl.rlim_cur);
+    signal(SIGPIPE, SIG_IGN);
+
+    sh=mmap(NULL, sizeof(shared_t), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    dev=calloc(n_dev, sizeof(device_t));
+    if (sh==MAP_FAILED || !dev) {perror("fleetsim"); return 2;}
+    sh->t0=clock_us();
+    for (int p=0; p<procs; p++) if (!fork()) {run(n_dev*p/procs, n_dev*(p+1)/procs); _exit(0);}
+
+    printf("%d devices on %d processes, %s:%d, %.1fx device clock, keepalive %d s\n", n_dev, procs, host, port, speedup, keepalive);
+    printf("%5s %9s %8s %9s %6s %7s %6s %6s %9s\n", "s", "connected", "acked/s", "connects", "fails", "drops", "lost", "full", "timeouts");
+    for (int i=0; i<=STORMS; i++) at[i][0]=at[i][1]=at[i][2]=-1;
+    for (uint64_t t=0, s=0; t<seconds*1000ULL; usleep(10000)) {
+        int c=__atomic_load_n(&sh->connected, __ATOMIC_RELAXED);
+        t=(clock_us()-sh->t0)/1000;
+        if (next<n_storms && t>=storms[next]*1000ULL+100) next++; //the storm has dropped everybody by now
+        double since=t/1000.0-(next ? storms[next-1] : 0);
+        if (at[next][0]<0 && c>=n_dev/2)      at[next][0]=since;
+        if (at[next][1]<0 && c>=n_dev*9/10)   at[next][1]=since;
+        if (at[next][2]<0 && c>=n_dev)        at[next][2]=since;
+        if (t/1000>s) { //the second that just ended
+            typeof(sh->sec[0]) *q=&sh->sec[s];
+            printf("%5lu %9d %8u %9u %6u %7u %6u %6u %9u\n", (unsigned long)s+1, c, q->acked, q->connects, q->fails,
+                    q->drops, q->lost, q->full, q->timeouts);
+            fflush(stdout);
+            s++;
+        }
+    }
+    while (wait(NULL)>0);
+
+    for (int s=0; s<seconds; s++) {
+        acked+=sh->sec[s].acked; connects+=sh->sec[s].connects; fails+=sh->sec[s].fails; drops+=sh->sec[s].drops;
+        lost+=sh->sec[s].lost; full+=sh->sec[s].full; timeouts+=sh->sec[s].timeouts;
+        if (sh->sec[s].acked>peak) peak=sh->sec[s].acked;
+    }
+    printf("\ningest: %lu publishes acked, %.1f/s average, %lu/s peak; %lu lost on drops, %lu queue full, %lu PUBACK timeouts\n",
+            (unsigned long)acked, (double)acked/seconds, (unsigned long)peak, (unsigned long)lost, (unsigned long)full,
+            (unsigned long)timeouts);
+    printf("sessions: %lu connects, %lu failed attempts, %lu drops\n", (unsigned long)connects, (unsigned long)fails,
+            (unsigned long)drops);
+    printf("latency ms    %8s %8s %8s %8s %8s\n", "p50", "p90", "p99", "p99.9", "max");
+    printf("to PUBACK     %8.2f %8.2f %8.2f %8.2f %8.2f\n", percentile(sh->pub, .5), percentile(sh->pub, .9),
+            percentile(sh->pub, .99), percentile(sh->pub, .999), percentile(sh->pub, 1));
+    printf("report call   %8.2f %8.2f %8.2f %8.2f %8.2f\n", percentile(sh->e2e, .5), percentile(sh->e2e, .9),
+            percentile(sh->e2e, .99), percentile(sh->e2e, .999), percentile(sh->e2e, 1));
+    printf("reconnect s   %8s %8s %8s\n", "50%", "90%", "100%");
+    for (int i=0; i<=n_storms; i++) {
+        char name[16];
+        if (i) snprintf(name, sizeof(name), "storm %d s", storms[i-1]); else strcpy(name, "boot");
+        printf("%-13s", name);
+        for (int k=0; k<3; k++) at[i][k]<0 ? printf(" %8s", "never") : printf(" %8.2f", at[i][k]);
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,159 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Where the flash and RAM of the firmware go, from the linker map
+ *  footprint map [budget...]    JSON report on stdout, a summary per component on stderr
+ *  every input section is attributed by its address to iram, data (data+rodata), bss or irom
+ *  and to its object file and component (the archive it came from, 'program' are our own sources)
+ *  budgets are region=bytes or component.region=bytes, with regions iram data bss irom
+ *  plus dram (data+bss) and image (iram+data+irom, what has to fit in the OTA slot)
+ *  exits 1 if a budget is exceeded
+ *  build with: make footprint
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {IRAM, DATA, BSS, IROM, REGIONS};
+static const char *region_name[]={"iram","data","bss","irom"};
+
+typedef struct {
+    char     component[64], object[64];
+    uint32_t size[REGIONS];
+} entry_t;
+
+static entry_t *objects=NULL, *components=NULL;
+static int object_count=0, component_count=0;
+
+static entry_t *find(entry_t **list, int *count, const char *component, const char *object) {
+    for (int i=0; i<*count; i++) {
+        if (!strcmp((*list)[i].component,component) && !strcmp((*list)[i].object,object)) return *list+i;
+    }
+    if (!(*count&63)) *list=realloc(*list, (*count+64)*sizeof(entry_t));
+    entry_t *e=*list+(*count)++;
+    memset(e, 0, sizeof(entry_t));
+    snprintf(e->component, sizeof(e->component), "%s", component);
+    snprintf(e->object,    sizeof(e->object),    "%s", object);
+    return e;
+}
+
+static int region(uint32_t addr, const char *out_section) {
+    if (addr>=0x40100000 && addr<0x40110000) return IRAM;
+    if (addr>=0x40200000 && addr<0x40300000) return IROM;
+    if (addr>=0x3FFE8000 && addr<0x40000000) return strncmp(out_section,".bss",4) ? DATA : BSS;
+    return -1; //debug info and the like, not loaded
+}
+
+//  /path/libmain.a(app_main.o) -> libmain, app_main.o     build/program/main.o -> program, main.o
+static void split(const char *path, char *component, char *object) {
+    const char *paren=strchr(path,'('), *base, *end;
+    if (paren) {
+        for (base=end=paren; base>path && base[-1]!='/'; base--);
+        if (end-base>2 && !strncmp(end-2,".a",2)) end-=2;
+        snprintf(component, 64, "%.*s", (int)(end-base), base);
+        snprintf(object, 64, "%.*s", (int)strcspn(paren+1,")"), paren+1);
+    } else {
+        base=strrchr(path,'/');
+        snprintf(object, 64, "%s", base ? base+1 : path);
+        if (!base) {strcpy(component,"other"); return;}
+        for (end=base; base>path && base[-1]!='/'; base--);
+        snprintf(component, 64, "%.*s", (int)(end-base), base);
+    }
+}
+
+static void add(const char *out_section, uint32_t addr, uint32_t size, const char *path) {
+    char component[64], object[64];
+    int  r=region(addr, out_section);
+    if (r<0 || !size) return;
+    split(path, component, object);
+    find(&objects,    &object_count,    component, object)->size[r]+=size;
+    find(&components, &component_count, component, "")->size[r]+=size;
+}
+
+static uint32_t derived(const entry_t *e, const char *name) {
+    for (int r=0; r<REGIONS; r++) if (!strcmp(name,region_name[r])) return e->size[r];
+    if (!strcmp(name,"dram"))  return e->size[DATA]+e->size[BSS];
+    if (!strcmp(name,"image")) return e->size[IRAM]+e->size[DATA]+e->size[IROM];
+    return UINT32_MAX;
+}
+
+static int by_total(const void *a, const void *b) {
+    uint32_t sa=0, sb=0;
+    for (int r=0; r<REGIONS; r++) {sa+=((entry_t*)a)->size[r]; sb+=((entry_t*)b)->size[r];}
+    return sa<sb ? 1 : sa>sb ? -1 : 0;
+}
+
+static void print_sizes(const entry_t *e) {
+    for (int r=0; r<REGIONS; r++) printf("%s\"%s\":%u", r?",":"", region_name[r], e->size[r]);
+}
+
+int main(int argc, char *argv[]) {
+    char line[512], out_section[64]="", pending[128]="", name[128], path[256];
+    unsigned long addr, size;
+    int  in_map=0, failed=0;
+    FILE *map;
+    entry_t total;
+
+    if (argc<2 || !(map=fopen(argv[1],"r"))) {
+        fprintf(stderr, "usage: footprint map [region=bytes|component.region=bytes...]\n");
+        return 2;
+    }
+    while (fgets(line, sizeof(line), map)) {
+        if (!in_map) {in_map=!strncmp(line,"Linker script and memory map",28); continue;}
+        if (line[0]=='.') { //output section, address and size can be on the next line
+            sscanf(line, "%63s", out_section);
+            pending[0]=0;
+        } else if (line[0]==' ' && (line[1]=='.' || !strncmp(line+1,"COMMON",6))) { //input section
+            int n=sscanf(line, " %127s %lx %lx %255s", name, &addr, &size, path);
+            if (n==4) add(out_section, addr, size, path);
+            else if (n==1) strcpy(pending, name);
+        } else if (pending[0]) { //continuation of a long input section name
+            if (sscanf(line, " %lx %lx %255s", &addr, &size, path)==3) add(out_section, addr, size, path);
+            pending[0]=0;
+        }
+    }
+    fclose(map);
+    if (!in_map) {fprintf(stderr, "%s is not a linker map\n", argv[1]); return 2;}
+
+    qsort(objects,    object_count,    sizeof(entry_t), by_total);
+    qsort(components, component_count, sizeof(entry_t), by_total);
+    memset(&total, 0, sizeof(total));
+    for (int i=0; i<component_count; i++) for (int r=0; r<REGIONS; r++) total.size[r]+=components[i].size[r];
+
+    printf("{\"total\":{"); print_sizes(&total);
+    printf(",\"dram\":%u,\"image\":%u},\n\"components\":[\n", derived(&total,"dram"), derived(&total,"image"));
+    for (int i=0; i<component_count; i++) {
+        printf("{\"component\":\"%s\",", components[i].component); print_sizes(components+i);
+        printf("}%s\n", i<component_count-1 ? "," : "");
+    }
+    printf("],\n\"objects\":[\n");
+    for (int i=0; i<object_count; i++) {
+        printf("{\"component\":\"%s\",\"object\":\"%s\",", objects[i].component, objects[i].object); print_sizes(objects+i);
+        printf("}%s\n", i<object_count-1 ? "," : "");
+    }
+    printf("],\n\"budgets\":[\n");
+    for (int i=2; i<argc; i++) {
+        char key[128], *eq=strchr(argv[i],'='), *dot;
+        const entry_t *e=&total;
+        uint32_t used, limit;
+        if (!eq || eq-argv[i]>=(int)sizeof(key)) {fprintf(stderr, "bad budget %s\n", argv[i]); return 2;}
+        snprintf(key, sizeof(key), "%.*s", (int)(eq-argv[i]), argv[i]);
+        limit=strtoul(eq+1, NULL, 0);
+        if ((dot=strchr(key,'.'))) { //component.region
+            *dot=0; e=NULL;
+            for (int c=0; c<component_count; c++) if (!strcmp(components[c].component,key)) e=components+c;
+            *dot='.';
+        }
+        if (!e || (used=derived(e, dot ? dot+1 : key))==UINT32_MAX) {fprintf(stderr, "unknown budget %s\n", key); return 2;}
+        printf("{\"budget\":\"%s\",\"used\":%u,\"limit\":%u,\"ok\":%s}%s\n", key, used, limit, used<=limit ? "true" : "false",
+                i<argc-1 ? "," : "");
+        if (used>limit) {fprintf(stderr, "footprint budget %s exceeded: %u > %u bytes\n", key, used, limit); failed=1;}
+    }
+    printf("]}\n");
+
+    fprintf(stderr, "%-24s %8s %8s %8s %8s\n", "component", "iram", "data", "bss", "irom");
+    for (int i=0; i<component_count; i++) fprintf(stderr, "%-24s %8u %8u %8u %8u\n", components[i].component,
+            components[i].size[IRAM], components[i].size[DATA], components[i].size[BSS], components[i].size[IROM]);
+    fprintf(stderr, "%-24s %8u %8u %8u %8u  image %u\n", "total",
+            total.size[IRAM], total.size[DATA], total.size[BSS], total.size[IROM], derived(&total,"image"));
+    return failed;
+}
@@ -0,0 +1,216 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Host test of the log sink ring in logsink.c, the FreeRTOS calls run on pthreads (tools/posix)
+ *  logtest [seed]
+ *  producer threads log numbered text lines and binary records of random length as fast as they can, the drain task
+ *  sends them to a fake UDP socket and UART while the network comes and goes, so the ring wraps many thousand times
+ *  a line that log_put accepted must arrive exactly once, intact and in the order of its producer, on the serial port
+ *  every text line, by UDP every line unless the drain skipped it for lack of an IP (then serial_only counts it)
+ *  packets must be of one kind, on the port of that kind and not longer than LOG_PACKET
+ *  one tick is 1/TICKS_PER_US us, so the rate limits of the levels still let enough through to fill the ring
+ *  build and run with: make logtest
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#define LOG_HOST
+#include "../logsink.c"
+
+#define PRODUCERS    4
+#define LINES   200000 //per producer
+#define TICKS_PER_US 20
+#define UART_CHUNK  512 //chars between pauses of the UART
+#define UART_PAUSE   20 //us
+
+static pthread_mutex_t critical=PTHREAD_MUTEX_INITIALIZER, notify_lock=PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  notify_cond=PTHREAD_COND_INITIALIZER;
+static uint32_t        notified;
+static pthread_t       drain_thread;
+static volatile bool   online=true;
+static volatile int    finished;
+
+static bool     accepted[PRODUCERS][LINES];
+static uint32_t *udp_seq[PRODUCERS], *serial_seq[PRODUCERS];
+static int      udp_n[PRODUCERS], serial_n[PRODUCERS], packets;
+static uint32_t errors;
+
+static void error(const char *what, int p, uint32_t seq) {
+    if (errors++<10) fprintf(stderr, "  %s: producer %d line %u\n", what, p, seq);
+}
+
+TickType_t xTaskGetTickCount(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec*1000000000ULL+ts.tv_nsec)/(1000/TICKS_PER_US);
+}
+
+void taskENTER_CRITICAL(void) {pthread_mutex_lock(&critical);}
+void taskEXIT_CRITICAL(void)  {pthread_mutex_unlock(&critical);}
+
+static void *task_start(void *arg) {drain_task(NULL); return NULL;}
+
+int xTaskCreate(TaskFunction_t code, const char *name, uint16_t stack, void *arg, int priority, TaskHandle_t *task) {
+    pthread_create(&drain_thread, NULL, task_start, NULL); //only the drain task is created
+    *task=&drain_thread;
+    return 1;
+}
+
+void xTaskNotifyGive(TaskHandle_t task) {
+    pthread_mutex_lock(&notify_lock);
+    notified++;
+    pthread_cond_signal(&notify_cond);
+    pthread_mutex_unlock(&notify_lock);
+}
+
+uint32_t ulTaskNotifyTake(bool clear, TickType_t wait) {
+    struct timespec ts;
+    uint32_t n;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec+=(wait==portMAX_DELAY ? 1000000 : wait*1000/TICKS_PER_US); //a missed notify only costs a ms
+    if (ts.tv_nsec>=1000000000) {ts.tv_sec++; ts.tv_nsec-=1000000000;}
+    pthread_mutex_lock(&notify_lock);
+    if (!notified) pthread_cond_timedwait(&notify_cond, &notify_lock, &ts);
+    n=notified;
+    notified=clear ? 0 : n ? n-1 : 0;
+    pthread_mutex_unlock(&notify_lock);
+    return n;
+}
+
+void power_tx(void) {}
+
+int sdk_wifi_station_get_connect_status(void) {return online ? STATION_GOT_IP : 0;}
+
+static char filler(int p, uint32_t seq, int i) {return 'a'+(p*7+seq*13+i)%26;}
+
+static int make_line(int p, uint32_t seq, int len, uint8_t *out) { //len total, returns the kind
+    int n;
+    if (seq%5==0) { //binary: length, producer, seq, filler
+        out[0]=len; out[1]=p;
+        memcpy(out+2, &seq, 4);
+        n=6;
+        for (; n<len; n++) out[n]=filler(p, seq, n);
+        return LOG_BINARY;
+    }
+    n=sprintf((char*)out, "%d %u ", p, seq);
+    for (; n<len-1; n++) out[n]=filler(p, seq, n);
+    out[n]='\n';
+    return LOG_TEXT;
+}
+
+static int check_line(const uint8_t *data, int len, int kind, bool serial) { //returns the bytes taken, 0 on garbage
+    int      p, n;
+    uint8_t  expect[LOG_LINE];
+    uint32_t seq;
+    if (kind==LOG_BINARY) {
+        if (len<6 || data[0]<6 || data[0]>len || data[1]>=PRODUCERS) return 0;
+        p=data[1]; memcpy(&seq, data+2, 4); n=data[0];
+    } else {
+        const uint8_t *nl=memchr(data, '\n', len);
+        if (!nl || sscanf((const char*)data, "%d %u ", &p, &seq)!=2 || p<0 || p>=PRODUCERS) return 0;
+        n=nl-data+1;
+    }
+    if (seq>=LINES) return 0;
+    if (make_line(p, seq, n, expect)!=kind || memcmp(expect, data, n)) {error("corrupted", p, seq); return n;}
+    if (serial) serial_seq[p][serial_n[p]++]=seq;
+    else        udp_seq[p][udp_n[p]++]=seq;
+    return n;
+}
+
+static char     serial_line[LOG_LINE+1];
+static int      serial_len;
+static uint32_t serial_chars;
+
+void uart_putc(int uart, char c) { //slow, so the UART falls behind UDP and its tail limits the producers
+    if (++serial_chars%UART_CHUNK==0) usleep(UART_PAUSE);
+    if (serial_len<(int)sizeof(serial_line)) serial_line[serial_len++]=c;
+    if (c!='\n') return;
+    if (!check_line((uint8_t*)serial_line, serial_len, LOG_TEXT, true)) error("garbage on serial", -1, 0);
+    serial_len=0;
+}
+
+int lwip_socket(int domain, int type, int protocol) {return 3;}
+
+int lwip_sendto(int s, const void *data, size_t size, int flags, const struct sockaddr *to, socklen_t tolen) {
+    const uint8_t *d=data;
+    int port=ntohs(((const struct sockaddr_in*)to)->sin_port), kind=port==LOG_PORT ? LOG_TEXT : LOG_BINARY;
+    packets++;
+    if (size>LOG_PACKET || (port!=LOG_PORT && port!=BLOG_PORT)) error("bad packet", -1, size);
+    for (size_t i=0, n; i<size; i+=n) { //a line of the other kind does not parse or check
+        if (!(n=check_line(d+i, size-i, kind, false))) {error("garbage or kinds mixed in packet", -1, packets); break;}
+    }
+    return size;
+}
+
+static void *producer(void *arg) {
+    int      p=(intptr_t)arg, kind, len;
+    uint8_t  line[LOG_LINE];
+    unsigned seed=p;
+    for (uint32_t seq=0; seq<LINES; seq++) {
+        len=12+rand_r(&seed)%(LOG_LINE-12);
+        kind=make_line(p, seq, len, line);
+        accepted[p][seq]=!log_put(rand_r(&seed)%LOG_LEVELS, kind, line, len);
+        if (rand_r(&seed)%64==0) sched_yield();
+    }
+    __sync_fetch_and_add(&finished, 1);
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    pthread_t threads[PRODUCERS];
+    uint32_t  logged=0, rate=0, full=0, total=0, by_udp=0, expect;
+    int       seed=argc>1 ? atoi(argv[1]) : 1;
+
+    srand(seed);
+    for (int p=0; p<PRODUCERS; p++) {
+        udp_seq[p]=malloc(LINES*sizeof(uint32_t));
+        serial_seq[p]=malloc(LINES*sizeof(uint32_t));
+    }
+    log_init(0);
+    for (int p=0; p<PRODUCERS; p++) pthread_create(threads+p, NULL, producer, (void*)(intptr_t)p);
+    while (finished<PRODUCERS) { //the network comes and goes
+        online=rand()%3!=0;
+        usleep(rand()%2000);
+    }
+    for (int p=0; p<PRODUCERS; p++) pthread_join(threads[p], NULL);
+    online=true;
+    for (int i=0; i<5000 && oldest()!=head; i++) {xTaskNotifyGive(drain_handle); usleep(1000);}
+    if (oldest()!=head) error("ring not drained", -1, head-oldest());
+
+    for (int i=0; i<LOG_LEVELS; i++) {
+        logged+=log_counters[i].logged; rate+=log_counters[i].dropped_rate; full+=log_counters[i].dropped_full;
+    }
+    for (int p=0; p<PRODUCERS; p++) {
+        for (uint32_t seq=0; seq<LINES; seq++) total+=accepted[p][seq];
+#ifdef LOG_SERIAL
+        int s=0;
+        for (uint32_t seq=0; seq<LINES; seq++) if (accepted[p][seq] && seq%5) { //text lines only
+            if (s>=serial_n[p] || serial_seq[p][s]!=seq) {error("serial out of order or missing", p, seq); break;}
+            s++;
+        }
+        if (s!=serial_n[p]) error("serial lines that were not accepted", p, serial_n[p]-s);
+#endif
+        for (int i=0; i<udp_n[p]; i++) {
+            if (i && udp_seq[p][i]<=udp_seq[p][i-1]) error("UDP out of order or twice", p, udp_seq[p][i]);
+            if (!accepted[p][udp_seq[p][i]]) error("UDP line that was not accepted", p, udp_seq[p][i]);
+        }
+        by_udp+=udp_n[p];
+    }
+    expect=total;
+#ifdef LOG_SERIAL
+    expect-=serial_only;
+#endif
+    if (logged!=total) error("logged counter off", -1, logged-total);
+    if (by_udp!=expect) error("lines lost on UDP", -1, expect-by_udp);
+    printf("%s %u lines through %u wraps of the ring in %d packets, dropped %u by rate %u full",
+            errors ? "FAIL" : "ok", total, head/LOG_RING, packets, rate, full);
+#ifdef LOG_SERIAL
+    printf(", %u only on serial", serial_only);
+#endif
+    printf(", %u errors\n", errors);
+    return errors!=0;
+}
@@ -0,0 +1,207 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Soak a running pumpswitch to compare lwIP profiles (make LWIP_LEAN=0 or 1, both with SOAK=1)
+ *  lwipsoak ip [seconds] [clients] [label] [bulk bytes]
+ *  each client keeps opening a connection to the HomeKit port and requests /accessories, which an unpaired or
+ *  unverified session answers with a short error, so it measures the stack and the server, not the crypto
+ *  that fits in one segment, so one more client keeps a connection to the bulk endpoint of soak.h and sends and
+ *  receives rounds of bulk bytes (default 16384, 0 for none): many segments of MSS size both ways, a full window,
+ *  and with Wi-Fi losses out of order segments and SACK, the pattern is checked on both ends
+ *  meanwhile it listens to the log sink for the heap lines that SOAK=1 makes the device send every 10 seconds
+ *  prints one line with request rate, throughput, response latency percentiles, bulk throughput and round time,
+ *  and the lowest free heap seen
+ *  build with: make lwipsoak
+ */
+#define _GNU_SOURCE //strcasestr
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "../soak.h"
+
+#define LOG_PORT     45678 //see logsink.h
+#define HOMEKIT_PORT  5556
+#define MAX_SAMPLES 200000
+
+static struct sockaddr_in device;
+static volatile int stop;
+static pthread_mutex_t lock=PTHREAD_MUTEX_INITIALIZER;
+static uint32_t latency_us[MAX_SAMPLES], samples, errors, heap_min=UINT32_MAX, heap_reports;
+static uint64_t bytes, bulk_bytes;
+static uint32_t bulk_us[MAX_SAMPLES], bulk_rounds, bulk_errors;
+static int      bulk_len;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000u+ts.tv_nsec/1000;
+}
+
+static int request(void) { //one connection with one request, returns bytes received or -1
+    static const char get[]="GET /accessories HTTP/1.1\r\nHost: pumpswitch\r\n\r\n";
+    struct timeval tv={5,0};
+    char buf[2048];
+    int  s=socket(AF_INET, SOCK_STREAM, 0), n, total=0, expect=-1;
+    uint64_t start;
+
+    if (s<0) return -1;
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    if (connect(s, (struct sockaddr*)&device, sizeof(device))<0) {close(s); return -1;}
+    start=now_us();
+    if (write(s, get, sizeof(get)-1)!=sizeof(get)-1) {close(s); return -1;}
+    while ((n=read(s, buf, sizeof(buf)-1))>0) {
+        if (!total) { //first bytes of the response
+            uint32_t us=now_us()-start;
+            pthread_mutex_lock(&lock);
+            if (samples<MAX_SAMPLES) latency_us[samples++]=us;
+            pthread_mutex_unlock(&lock);
+        }
+        buf[n]=0;
+        if (expect<0) { //headers arrive in the first segment
+            char *body=strstr(buf,"\r\n\r\n"), *len=strcasestr(buf,"Content-Length:");
+            if (body) expect=total+(body+4-buf)+(len ? atoi(len+15) : 0);
+        }
+        total+=n;
+        if (expect>=0 && total>=expect) break; //keep-alive, do not wait for the close
+    }
+    close(s);
+    return total ? total : -1;
+}
+
+static void *client(void *arg) {
+    (void)arg;
+    while (!stop) {
+        int n=request();
+        pthread_mutex_lock(&lock);
+        if (n<0) errors++; else bytes+=n;
+        pthread_mutex_unlock(&lock);
+        if (n<0) usleep(100000); //out of sockets or memory, back off a little
+    }
+    return NULL;
+}
+
+static int bulk_connect(void) {
+    struct sockaddr_in addr=device;
+    struct timeval tv={10,0};
+    int s=socket(AF_INET, SOCK_STREAM, 0);
+    addr.sin_port=htons(SOAK_PORT);
+    if (s<0) return -1;
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    if (connect(s, (struct sockaddr*)&addr, sizeof(addr))<0) {close(s); return -1;}
+    return s;
+}
+
+static int bulk_round(int s) { //bulk_len bytes up and the same back, 0 if all arrived and matched
+    static uint8_t up[SOAK_MAX], down[SOAK_MAX];
+    uint32_t len=htonl(bulk_len);
+    int      n;
+    for (int i=0; i<bulk_len; i++) up[i]=soak_pattern(i);
+    if (write(s, &len, 4)!=4) return -1;
+    for (int i=0; i<bulk_len; i+=n) if ((n=write(s, up+i, bulk_len-i))<=0) return -1;
+    for (int i=0; i<bulk_len; i+=n) if ((n=read(s, down+i, bulk_len-i))<=0) return -1;
+    return memcmp(up, down, bulk_len) ? -1 : 0;
+}
+
+static void *bulk_client(void *arg) {
+    (void)arg;
+    int s=-1;
+    while (!stop) {
+        if (s<0 && (s=bulk_connect())<0) {
+            pthread_mutex_lock(&lock); bulk_errors++; pthread_mutex_unlock(&lock);
+            sleep(1);
+            continue;
+        }
+        uint64_t start=now_us();
+        int      fail=bulk_round(s);
+        pthread_mutex_lock(&lock);
+        if (fail) bulk_errors++;
+        else {
+            if (bulk_rounds<MAX_SAMPLES) bulk_us[bulk_rounds]=now_us()-start;
+            bulk_rounds++;
+            bulk_bytes+=2*bulk_len;
+        }
+        pthread_mutex_unlock(&lock);
+        if (fail) {close(s); s=-1;} //the device closes too
+    }
+    if (s>=0) close(s);
+    return NULL;
+}
+
+static void *log_listener(void *arg) {
+    (void)arg;
+    struct sockaddr_in addr={.sin_family=AF_INET, .sin_port=htons(LOG_PORT), .sin_addr.s_addr=htonl(INADDR_ANY)}, from;
+    struct timeval tv={1,0};
+    socklen_t fromlen;
+    char     packet[1500], *line;
+    int      s=socket(AF_INET, SOCK_DGRAM, 0), one=1, n;
+    unsigned free, min;
+
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (bind(s, (struct sockaddr*)&addr, sizeof(addr))<0) {perror("log port"); return NULL;}
+    while (!stop) {
+        fromlen=sizeof(from);
+        if ((n=recvfrom(s, packet, sizeof(packet)-1, 0, (struct sockaddr*)&from, &fromlen))<=0) continue;
+        if (from.sin_addr.s_addr!=device.sin_addr.s_addr) continue;
+        packet[n]=0;
+        for (line=strtok(packet,"\n"); line; line=strtok(NULL,"\n")) {
+            if (!(line=strstr(line,"heap free=")) || sscanf(line, "heap free=%u min=%u", &free, &min)!=2) continue;
+            pthread_mutex_lock(&lock);
+            if (min<heap_min) heap_min=min;
+            heap_reports++;
+            pthread_mutex_unlock(&lock);
+        }
+    }
+    close(s);
+    return NULL;
+}
+
+static int cmp(const void *a, const void *b) {
+    uint32_t x=*(const uint32_t*)a, y=*(const uint32_t*)b;
+    return x<y ? -1 : x>y;
+}
+
+int main(int argc, char *argv[]) {
+    int seconds=argc>2 ? atoi(argv[2]) : 300, clients=argc>3 ? atoi(argv[3]) : 4;
+    const char *label=argc>4 ? argv[4] : "soak";
+    pthread_t listener, thread[64], bulk;
+
+    bulk_len=argc>5 ? atoi(argv[5]) : 16384;
+    if (argc<2 || !inet_aton(argv[1], &device.sin_addr) || clients<1 || clients>64 || seconds<1 || bulk_len<0
+            || bulk_len>SOAK_MAX) {
+        fprintf(stderr, "usage: lwipsoak ip [seconds] [clients 1-64] [label] [bulk bytes 0-%d]\n", SOAK_MAX);
+        return 2;
+    }
+    device.sin_family=AF_INET;
+    device.sin_port=htons(HOMEKIT_PORT);
+    pthread_create(&listener, NULL, log_listener, NULL);
+    for (int i=0; i<clients; i++) pthread_create(thread+i, NULL, client, NULL);
+    if (bulk_len) pthread_create(&bulk, NULL, bulk_client, NULL);
+    sleep(seconds);
+    stop=1;
+    for (int i=0; i<clients; i++) pthread_join(thread[i], NULL);
+    if (bulk_len) pthread_join(bulk, NULL);
+    pthread_join(listener, NULL);
+
+    qsort(latency_us, samples, sizeof(latency_us[0]), cmp);
+    printf("%s clients=%d requests=%u errors=%u rate=%.1f/s throughput=%.1fkB/s", label, clients, samples, errors,
+            (double)samples/seconds, bytes/1024.0/seconds);
+    if (samples) printf(" latency p50=%.1fms p95=%.1fms p99=%.1fms max=%.1fms", latency_us[samples/2]/1000.0,
+            latency_us[samples*95/100]/1000.0, latency_us[samples*99/100]/1000.0, latency_us[samples-1]/1000.0);
+    if (bulk_len) {
+        uint32_t n=bulk_rounds<MAX_SAMPLES ? bulk_rounds : MAX_SAMPLES;
+        qsort(bulk_us, n, sizeof(bulk_us[0]), cmp);
+        printf(" bulk=%uB rounds=%u errors=%u throughput=%.1fkB/s", bulk_len, bulk_rounds, bulk_errors,
+                bulk_bytes/1024.0/seconds);
+        if (n) printf(" round p50=%.1fms max=%.1fms", bulk_us[n/2]/1000.0, bulk_us[n-1]/1000.0);
+    }
+    if (heap_reports) printf(" heap_min=%u (%u reports)\n", heap_min, heap_reports);
+    else printf(" heap_min=? (no heap lines, build with SOAK=1)\n");
+    return 0;
+}
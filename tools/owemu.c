@@ -0,0 +1,277 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Host test of the timer driven 1-Wire master in ow.c on an emulated bus with virtual DS18B20s
+ *  owemu [seed]
+ *  the bus runs in simulated microseconds: the timer interrupt of ow.c fires when its alarm is due plus a random
+ *  latency, the devices pick their own timing inside the datasheet limits for every slot (sample point, how long
+ *  they hold a 0, presence delay and length), so a master that is only right for nominal timing fails here
+ *  each case scans the bus, converts and reads all temperatures and compares ROMs and values,
+ *  it also counts master timing violations and reports the longest interrupt run, which is the masked time
+ *  then sensor.c reads two sensors on a random walk for many beats with bit flips on the bus while the scratchpad
+ *  is sent, a power loss (85 C) and a conversion that went wrong with a valid CRC: no value may be off or missing
+ *  build and run with: make owtest
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#define OW_HOST
+#include "../ow.c"
+#define SENSOR_HOST
+#include "../sensor.c"
+
+#define MAX_DEV 32
+
+enum {D_IDLE, D_ROM_CMD, D_MATCH, D_SEARCH, D_FUNC, D_SEND};
+
+typedef struct device {
+    uint64_t rom;
+    int16_t  temp;          //in 1/16 C, what the next conversion gives
+    uint8_t  pad[9];        //scratchpad
+    int      mode, bits, step;
+    uint64_t in;            //bits received in this mode
+    const uint8_t *out;     //bits to send
+    int      out_bits;
+    bool     sending;       //holds a 0 or sends a 1 in the current slot
+    int64_t  pull_from, pull_until;
+} device_t;
+
+static device_t dev[MAX_DEV];
+static int      n_dev, jitter, flip; //1 in flip scratchpad bits is read inverted
+static int64_t  now, due=-1, fall=-1000, release=-1000, low=480; //low: length of the last low pulse
+static bool     master_low, done;
+static uint32_t violations;
+
+static int rnd(int lo, int hi) {return lo+rand()%(hi-lo+1);}
+
+static void violation(const char *what, int64_t us) {
+    if (violations++<5) fprintf(stderr, "  timing violation at %lld us: %s (%lld us)\n", (long long)now, what, (long long)us);
+}
+
+static bool device_bit(device_t *d) { //the bit this device sends in the current slot
+    int n=d->bits;
+    if (d->mode==D_SEND) return (d->out[n/8]>>(n%8))&1;
+    return ((d->rom>>n)&1)^(d->step==1); //search: the ROM bit, then its complement
+}
+
+static void device_received(device_t *d, bool v) {
+    if (d->mode==D_SEARCH) { //the direction bit of a triplet, devices with the other bit drop out
+        if (v!=((d->rom>>d->bits)&1)) d->mode=D_IDLE;
+        else if (++d->bits==64) d->mode=D_IDLE;
+        d->step=0;
+        return;
+    }
+    d->in|=(uint64_t)v<<d->bits++;
+    switch (d->mode) {
+        case D_ROM_CMD:
+            if (d->bits<8) return;
+            d->bits=0; d->in&=0xff;
+            if      (d->in==0xcc) d->mode=D_FUNC;
+            else if (d->in==0x55) d->mode=D_MATCH;
+            else if (d->in==0xf0) {d->mode=D_SEARCH; d->step=0;}
+            else d->mode=D_IDLE;
+            d->in=0;
+            return;
+        case D_MATCH:
+            if (d->bits<64) return;
+            d->mode=d->in==d->rom ? D_FUNC : D_IDLE;
+            d->bits=0; d->in=0;
+            return;
+        case D_FUNC:
+            if (d->bits<8) return;
+            if (d->in==0x44) { //conversion, instantly
+                d->pad[0]=d->temp; d->pad[1]=d->temp>>8;
+                d->pad[8]=ow_crc8(d->pad, 8);
+                d->mode=D_IDLE;
+            } else if (d->in==0xbe) {d->mode=D_SEND; d->out=d->pad; d->out_bits=72;}
+            else d->mode=D_IDLE;
+            d->bits=0; d->in=0;
+            return;
+    }
+}
+
+void ow_hal_init(int pin) {(void)pin;}
+
+void ow_hal_low(void) {
+    if (master_low) return;
+    if (now-release<1) violation("recovery shorter than 1 us", now-release);
+    if (low<480 && now-fall<60) violation("slot shorter than 60 us", now-fall);
+    master_low=true;
+    fall=now;
+    for (int i=0; i<n_dev; i++) {
+        device_t *d=dev+i;
+        d->sending=d->mode==D_SEND || (d->mode==D_SEARCH && d->step<2);
+        if (d->sending && !device_bit(d)) {d->pull_from=now; d->pull_until=now+rnd(15,60);}
+    }
+}
+
+void ow_hal_release(void) {
+    if (!master_low) return;
+    master_low=false;
+    release=now;
+    low=now-fall;
+    if (low>=480) { //reset, every device answers with a presence pulse
+        for (int i=0; i<n_dev; i++) {
+            dev[i].mode=D_ROM_CMD; dev[i].bits=0; dev[i].in=0;
+            dev[i].pull_from=now+rnd(15,60);
+            dev[i].pull_until=dev[i].pull_from+rnd(60,240);
+        }
+        return;
+    }
+    if (low>120) violation("write 0 longer than 120 us", low);
+    else if (low>15 && low<60) violation("low between 15 and 60 us", low);
+    for (int i=0; i<n_dev; i++) {
+        device_t *d=dev+i;
+        if (d->mode==D_IDLE) continue;
+        if (d->sending) { //it did not look at the master, just move on
+            if (d->mode==D_SEND) {if (++d->bits==d->out_bits) d->mode=D_IDLE;}
+            else d->step++;
+        } else device_received(d, low<rnd(15,60)); //the master was back high by the time the device sampled
+    }
+}
+
+bool ow_hal_read(void) {
+    if (master_low) return false;
+    if (low<480 && now-fall>15) violation("read sampled later than 15 us", now-fall);
+    bool v=true, sending=false;
+    for (int i=0; i<n_dev; i++) {
+        if (now>=dev[i].pull_from && now<dev[i].pull_until) v=false;
+        sending|=dev[i].mode==D_SEND;
+    }
+    return sending && flip && rand()%flip==0 ? !v : v;
+}
+
+void ow_hal_delay(uint32_t us) {now+=us;}
+void ow_hal_arm(uint32_t us)   {due=now+us+(jitter ? rand()%(jitter+1) : 0);}
+void ow_hal_done(void)         {done=true; due=-1;}
+void ow_hal_stop(void)         {due=-1; ow_hal_release();}
+void ow_hal_sleep(int ms)      {now+=ms*1000;}
+uint32_t ow_hal_cycles(void)   {return now;}
+
+bool ow_hal_wait(void) {
+    while (!done) {
+        if (due<0) return false;
+        now=due; due=-1;
+        ow_isr(NULL);
+    }
+    done=false;
+    return true;
+}
+
+static uint64_t make_rom(void) {
+    uint8_t b[8];
+    uint64_t rom=0;
+    b[0]=0x28; //DS18B20 family
+    for (int k=1; k<7; k++) b[k]=rand();
+    b[7]=ow_crc8(b, 7);
+    for (int k=0; k<8; k++) rom|=(uint64_t)b[k]<<(8*k);
+    return rom;
+}
+
+static int cmp(const void *a, const void *b) {
+    uint64_t x=*(const uint64_t*)a, y=*(const uint64_t*)b;
+    return x<y ? -1 : x>y;
+}
+
+static const uint8_t pad[9]={0x50,0x05,0x4b,0x46,0x7f,0xff,0x0c,0x10,0}; //85 C after power up
+
+static int run(int devices, int jitter_us) {
+    uint64_t found[MAX_DEV], roms[MAX_DEV];
+    float    temps[MAX_DEV];
+    int      n, bad=0;
+    int64_t  t0;
+
+    n_dev=devices; jitter=jitter_us; violations=0;
+    memset(&ow_stats, 0, sizeof(ow_stats));
+    for (int i=0; i<n_dev; i++) {
+        memset(dev+i, 0, sizeof(device_t));
+        dev[i].rom=roms[i]=make_rom();
+        dev[i].temp=rnd(-55*16, 125*16);
+        memcpy(dev[i].pad, pad, 9);
+        dev[i].pad[8]=ow_crc8(pad, 8);
+        dev[i].pull_until=-1;
+    }
+    t0=now;
+    n=ow_ds18b20_scan_devices(2, found, MAX_DEV);
+    int64_t scan=now-t0;
+    if (!n_dev) {
+        bad=n!=OW_ERR_PRESENCE;
+        printf("%-4s devices=0 scan=%d (expect %d)\n", bad ? "FAIL" : "ok", n, OW_ERR_PRESENCE);
+        return bad;
+    }
+    qsort(roms, n_dev, sizeof(roms[0]), cmp);
+    if (n!=n_dev) bad=1;
+    else {
+        qsort(found, n, sizeof(found[0]), cmp);
+        bad=memcmp(found, roms, n*sizeof(found[0]))!=0;
+    }
+    t0=now;
+    if (!ow_ds18b20_measure(2, ~(uint64_t)0, false) || n<1) bad=1;
+    else {
+        ow_ds18b20_read_temp_multi(2, found, n, temps);
+        for (int i=0; i<n; i++) for (int j=0; j<n_dev; j++)
+            if (dev[j].rom==found[i] && temps[i]!=dev[j].temp/16.0f) bad=1;
+    }
+    if (!jitter && violations) bad=1;
+    printf("%-4s devices=%2d jitter=%2dus found=%2d scan=%5.1fms read=%5.1fms slots=%5u late=%u errors=%u "
+           "violations=%u isr max=%uus avg=%.1fus\n", bad ? "FAIL" : "ok", devices, jitter_us, n, scan/1000.0,
+           (now-t0)/1000.0, ow_stats.slots, ow_stats.late, ow_stats.errors, violations, ow_stats.isr_max,
+           (double)ow_stats.isr_cycles/(ow_stats.slots ? ow_stats.slots : 1));
+    return bad;
+}
+
+static int sensor_run(int beats, int flip_rate) { //the acquisition layer through ow.c, as state_job uses it
+    uint64_t roms[SENSOR_MAX];
+    float    temps[SENSOR_MAX];
+    int16_t  truth[SENSOR_MAX];
+    int      off=0, late=0, nan=0, bad;
+    uint32_t errors=0;
+
+    n_dev=SENSOR_MAX; jitter=10; violations=0; flip=0;
+    memset(&ow_stats, 0, sizeof(ow_stats));
+    memset(sensor_stats, 0, sizeof(sensor_stats));
+    for (int i=0; i<n_dev; i++) {
+        memset(dev+i, 0, sizeof(device_t));
+        dev[i].rom=roms[i]=make_rom();
+        dev[i].temp=truth[i]=rnd(10*16, 60*16);
+        memcpy(dev[i].pad, pad, 9);
+        dev[i].pull_until=-1;
+    }
+    for (int b=0; b<beats; b++) {
+        for (int i=0; i<n_dev; i++) { //a slow random walk, the filter must pass it without delay
+            truth[i]+=rnd(-2, 2);
+            dev[i].temp=truth[i];
+        }
+        if (b==beats/3) dev[0].temp=SENSOR_POR;    //lost power during the conversion
+        if (b==beats/2) dev[1].temp=truth[1]+20*16; //a conversion gone wrong, the CRC is fine
+        ow_ds18b20_measure(2, ~(uint64_t)0, false);
+        flip=flip_rate;
+        sensor_read(2, roms, n_dev, temps);
+        flip=0;
+        errors+=sensor_health();
+        for (int i=0; i<n_dev; i++) {
+            if (isnan(temps[i])) nan++;
+            else if (fabsf(temps[i]-truth[i]/16.0f)>4/16.0f) off++; //a held or median value is a beat or two old
+            else if (temps[i]!=truth[i]/16.0f) late++;
+        }
+    }
+    bad=off || nan;
+    printf("%-4s sensors=%d beats=%d flip=1/%d bus errors=%u reads=%u retried=%u failed=%u spikes=%u held=%u "
+           "late=%d off=%d missing=%d\n", bad ? "FAIL" : "ok", n_dev, beats, flip_rate, errors,
+           sensor_stats[0].reads+sensor_stats[1].reads, sensor_stats[0].retried+sensor_stats[1].retried,
+           sensor_stats[0].failed+sensor_stats[1].failed, sensor_stats[0].spikes+sensor_stats[1].spikes,
+           sensor_stats[0].held+sensor_stats[1].held, late, off, nan);
+    return bad;
+}
+
+int main(int argc, char *argv[]) {
+    static const int devices[]={0,1,2,5,20}, jitters[]={0,10,25};
+    int failed=0;
+
+    srand(argc>1 ? atoi(argv[1]) : 1);
+    ow_init(2);
+    for (int j=0; j<3; j++) for (int i=0; i<5; i++) failed|=run(devices[i], jitters[j]);
+    failed|=sensor_run(10000, 2000);
+    printf("interrupt masked time is the longest ISR run of bus time, on the device ow_report measures CPU cycles\n");
+    return failed;
+}
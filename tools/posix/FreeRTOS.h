@@ -0,0 +1,14 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  POSIX shim of the FreeRTOS bits that report.c, blog.c and logsink.c use, for host tools like tools/fleetsim and tools/logtest
+ *  the tool defines xTaskGetTickCount, one tick is one millisecond of its (virtual) device clock
+ */
+#ifndef __POSIX_FREERTOS_H__
+#define __POSIX_FREERTOS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef uint32_t TickType_t;
+#define portTICK_PERIOD_MS 1
+
+#endif // __POSIX_FREERTOS_H__
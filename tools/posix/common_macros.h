@@ -0,0 +1,10 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  POSIX shim, see FreeRTOS.h: constants stay where the compiler puts them
+ */
+#ifndef __POSIX_COMMON_MACROS_H__
+#define __POSIX_COMMON_MACROS_H__
+
+#define IROM
+#define IRAM
+
+#endif // __POSIX_COMMON_MACROS_H__
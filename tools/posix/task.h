@@ -0,0 +1,22 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  POSIX shim, see FreeRTOS.h
+ *  the task calls are only declared, tools/logtest defines them on pthreads
+ */
+#ifndef __POSIX_TASK_H__
+#define __POSIX_TASK_H__
+
+#include "FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+#define pdTRUE        1
+#define portMAX_DELAY 0xffffffffU
+
+TickType_t xTaskGetTickCount(void);
+void       taskENTER_CRITICAL(void);
+void       taskEXIT_CRITICAL(void);
+int        xTaskCreate(TaskFunction_t code, const char *name, uint16_t stack, void *arg, int priority, TaskHandle_t *task);
+void       xTaskNotifyGive(TaskHandle_t task);
+uint32_t   ulTaskNotifyTake(bool clear, TickType_t wait);
+
+#endif // __POSIX_TASK_H__
@@ -0,0 +1,213 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Symbolises the histograms of a PROFILE build and prints where the CPU time goes
+ *  profsym [-w raw | -r raw] [-f folded] main.sym [main.map] [seconds]
+ *  main.sym is 'nm -n -S' of the ELF, the map (optional) gives the component (archive) of each function
+ *  listens on PROFILE_PORT for seconds (default 60), or reads packets saved with -w
+ *  stdout: flat profile per function and the share of each task, -f writes component;function count lines
+ *  for flamegraph.pl or speedscope
+ *  buckets are 16 bytes, a function smaller than that can get the samples of its neighbour
+ *  build with: make profsym
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "../profile.h"
+
+typedef struct {uint32_t addr, size; char *name; const char *component; uint64_t samples;} sym_t;
+typedef struct {uint32_t addr, size; char component[64];} range_t;
+
+static sym_t   *syms;
+static range_t *ranges;
+static int      n_syms, n_ranges;
+static struct {uint16_t task; char name[16]; uint64_t samples;} tasks[64];
+static int      n_tasks, packets, lost_packets;
+static uint64_t samples, lost, unknown;
+static uint16_t next_seq;
+static FILE     *raw;
+
+static uint16_t get16(const uint8_t *p) {return p[0] | p[1]<<8;}
+static uint32_t get32(const uint8_t *p) {return p[0] | p[1]<<8 | p[2]<<16 | (uint32_t)p[3]<<24;}
+
+static int task_index(uint16_t task) {
+    int i;
+    for (i=0; i<n_tasks && tasks[i].task!=task; i++);
+    if (i==n_tasks) {
+        if (n_tasks==64) return -1;
+        tasks[n_tasks++].task=task;
+        snprintf(tasks[i].name, sizeof(tasks[i].name), "task_%04x", task);
+    }
+    return i;
+}
+
+static sym_t *lookup(uint32_t pc) {
+    int lo=0, hi=n_syms-1;
+    if (!n_syms || pc<syms[0].addr) return NULL;
+    while (lo<hi) { //last symbol at or below pc
+        int mid=(lo+hi+1)/2;
+        if (syms[mid].addr<=pc) lo=mid; else hi=mid-1;
+    }
+    if (syms[lo].size && pc>=syms[lo].addr+syms[lo].size) return NULL;
+    return syms+lo;
+}
+
+static void packet(const uint8_t *p, int len) {
+    static const uint32_t base[]={0x40000000, 0x40100000, 0x40200000, 0};
+    int buckets, n;
+    if (len<PROFILE_HEADER || get32(p)!=PROFILE_MAGIC) return;
+    if (packets++ && get16(p+4)!=next_seq) lost_packets+=(uint16_t)(get16(p+4)-next_seq);
+    next_seq=get16(p+4)+1;
+    buckets=get16(p+12); n=p[14];
+    if (p[6]==1) { //task names
+        for (int i=0; i<n && PROFILE_HEADER+(i+1)*16<=len; i++) {
+            const uint8_t *e=p+PROFILE_HEADER+i*16;
+            int t=task_index(get16(e));
+            if (t>=0) snprintf(tasks[t].name, sizeof(tasks[t].name), "%.14s", (const char*)e+2);
+        }
+        return;
+    }
+    if (PROFILE_HEADER+(n+buckets)*4>len) return;
+    samples+=get16(p+8); lost+=get16(p+10);
+    for (int i=0; i<n; i++) {
+        int t=task_index(get16(p+PROFILE_HEADER+i*4));
+        if (t>=0) tasks[t].samples+=get16(p+PROFILE_HEADER+i*4+2);
+    }
+    for (int i=0; i<buckets; i++) {
+        uint32_t e=get32(p+PROFILE_HEADER+(n+i)*4), key=e>>PROFILE_COUNT_BITS, count=e&((1<<PROFILE_COUNT_BITS)-1);
+        int region=key>>16;
+        sym_t *s=region==PROFILE_OTHER ? NULL : lookup(base[region]+(key&0xffff)*16+15); //a function starting inside counts
+        if (s) s->samples+=count; else unknown+=count;
+    }
+}
+
+static void load_syms(const char *name) {
+    char line[512], type, sym[256];
+    unsigned addr, size;
+    FILE *f=fopen(name, "r");
+    if (!f) {perror(name); exit(2);}
+    while (fgets(line, sizeof(line), f)) {
+        int n=sscanf(line, "%x %x %c %255s", &addr, &size, &type, sym);
+        if (n!=4) {
+            if (sscanf(line, "%x %c %255s", &addr, &type, sym)!=3) continue;
+            size=0;
+        }
+        if (addr<0x40000000 || addr>=0x40300000 || !strchr("TtWwA", type)) continue; //code only
+        if (!(n_syms&1023)) syms=realloc(syms, (n_syms+1024)*sizeof(sym_t));
+        syms[n_syms++]=(sym_t){addr, size, strdup(sym), addr<0x40100000 ? "rom" : "?", 0};
+    }
+    fclose(f);
+}
+
+static void add_range(uint32_t addr, uint32_t size, const char *path) { //component as in tools/footprint
+    const char *paren=strchr(path,'('), *base, *end;
+    range_t *r;
+    if (addr<0x40100000 || addr>=0x40300000 || !size) return;
+    if (!(n_ranges&1023)) ranges=realloc(ranges, (n_ranges+1024)*sizeof(range_t));
+    r=ranges+n_ranges++;
+    r->addr=addr; r->size=size;
+    end=paren ? paren : strrchr(path,'/');
+    if (!end) {strcpy(r->component, "other"); return;}
+    for (base=end; base>path && base[-1]!='/'; base--);
+    if (paren && end-base>2 && !strncmp(end-2,".a",2)) end-=2;
+    snprintf(r->component, sizeof(r->component), "%.*s", (int)(end-base), base);
+}
+
+static void load_map(const char *name) {
+    char line[512], pending=0, section[128], path[256];
+    unsigned long addr, size;
+    int  in_map=0;
+    FILE *f=fopen(name, "r");
+    if (!f) {perror(name); exit(2);}
+    while (fgets(line, sizeof(line), f)) {
+        if (!in_map) {in_map=!strncmp(line,"Linker script and memory map",28); continue;}
+        if (line[0]==' ' && line[1]=='.') {
+            int n=sscanf(line, " %127s %lx %lx %255s", section, &addr, &size, path);
+            if (n==4) add_range(addr, size, path);
+            pending=n==1;
+        } else if (pending) {
+            if (sscanf(line, " %lx %lx %255s", &addr, &size, path)==3) add_range(addr, size, path);
+            pending=0;
+        }
+    }
+    fclose(f);
+    for (int i=0; i<n_syms; i++) for (int j=0; j<n_ranges; j++) {
+        if (syms[i].addr>=ranges[j].addr && syms[i].addr<ranges[j].addr+ranges[j].size) {
+            syms[i].component=ranges[j].component;
+            break;
+        }
+    }
+}
+
+static void listen_udp(int seconds) {
+    struct sockaddr_in addr={.sin_family=AF_INET, .sin_port=htons(PROFILE_PORT), .sin_addr.s_addr=htonl(INADDR_ANY)};
+    struct timeval tv={1,0};
+    uint8_t buf[1500];
+    int     s=socket(AF_INET, SOCK_DGRAM, 0), one=1, n;
+    time_t  end=time(NULL)+seconds;
+
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (bind(s, (struct sockaddr*)&addr, sizeof(addr))<0) {perror("profile port"); exit(2);}
+    while (time(NULL)<end) {
+        if ((n=recv(s, buf, sizeof(buf), 0))<=0) continue;
+        if (raw) {uint16_t len=n; fwrite(&len, 2, 1, raw); fwrite(buf, 1, n, raw);}
+        packet(buf, n);
+    }
+}
+
+static void read_raw(const char *name) {
+    uint8_t  buf[65536];
+    uint16_t len;
+    FILE *f=fopen(name, "rb");
+    if (!f) {perror(name); exit(2);}
+    while (fread(&len, 2, 1, f)==1 && fread(buf, 1, len, f)==len) packet(buf, len);
+    fclose(f);
+}
+
+static int by_samples(const void *a, const void *b) {
+    uint64_t x=((const sym_t*)a)->samples, y=((const sym_t*)b)->samples;
+    return x<y ? 1 : x>y ? -1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *replay=NULL, *folded=NULL;
+    int a=1;
+    for (; a+1<argc && argv[a][0]=='-'; a+=2) {
+        if      (!strcmp(argv[a],"-r")) replay=argv[a+1];
+        else if (!strcmp(argv[a],"-w")) {if (!(raw=fopen(argv[a+1],"wb"))) {perror(argv[a+1]); return 2;}}
+        else if (!strcmp(argv[a],"-f")) folded=argv[a+1];
+        else break;
+    }
+    if (a>=argc) {
+        fprintf(stderr, "usage: profsym [-w raw | -r raw] [-f folded] main.sym [main.map] [seconds]\n");
+        return 2;
+    }
+    load_syms(argv[a++]);
+    if (a<argc && !strchr("0123456789", argv[a][0])) load_map(argv[a++]);
+    if (replay) read_raw(replay);
+    else listen_udp(a<argc ? atoi(argv[a]) : 60);
+    if (raw) fclose(raw);
+    if (!samples) {fprintf(stderr, "no samples, is this a PROFILE build?\n"); return 1;}
+
+    qsort(syms, n_syms, sizeof(sym_t), by_samples);
+    printf("%llu samples, %llu lost in full histograms, %llu outside known code, %d packets lost\n\n",
+            (unsigned long long)samples, (unsigned long long)lost, (unsigned long long)unknown, lost_packets);
+    printf("%8s %6s  %-40s %s\n", "samples", "%", "function", "component");
+    for (int i=0; i<n_syms && syms[i].samples; i++) printf("%8llu %6.2f  %-40s %s\n",
+            (unsigned long long)syms[i].samples, 100.0*syms[i].samples/samples, syms[i].name, syms[i].component);
+    printf("\n%8s %6s  %s\n", "samples", "%", "task");
+    for (int i=0; i<n_tasks; i++) if (tasks[i].samples) printf("%8llu %6.2f  %s\n",
+            (unsigned long long)tasks[i].samples, 100.0*tasks[i].samples/samples, tasks[i].name);
+    if (folded) {
+        FILE *f=fopen(folded, "w");
+        if (!f) {perror(folded); return 2;}
+        for (int i=0; i<n_syms && syms[i].samples; i++)
+            fprintf(f, "%s;%s %llu\n", syms[i].component, syms[i].name, (unsigned long long)syms[i].samples);
+        if (unknown) fprintf(f, "?;? %llu\n", (unsigned long long)unknown);
+        fclose(f);
+    }
+    return 0;
+}
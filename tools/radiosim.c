@@ -0,0 +1,104 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Simulates the network schedule of pumpswitch and estimates the radio on time per hour like power.c does
+ *  radiosim [hours]
+ *  default:   logsink polls every 100 ms, the mqtt task yields 1 s between queue checks with a 10 s keepalive,
+ *             the ICMP ping and the stats sampler run at their own phase
+ *  LOW_POWER: logsink and mqtt task wake on their queue, keepalive 3 beats, ping and stats in the slot after the beat
+ *  transmits closer than POWER_TAIL ms together are one burst, a burst keeps the radio on until POWER_TAIL after it
+ *  beacon listening in modem/light sleep comes on top and is the same for both
+ *  build and run with: make radiosim
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "../power.h"
+
+#define BEAT      10000 //in milliseconds, see main.c
+#define CONVERT     750
+#define HOUR    3600000
+#define RTT          20 //ack or reply of the broker or hub
+#define MAX_TX    20000
+
+typedef struct schedule {
+    const char *name;
+    bool aligned;
+    int  keepalive;     //in milliseconds
+} schedule_t;
+
+static uint32_t tx[MAX_TX];
+static int      n_tx;
+
+static void transmit(uint32_t t) {
+    if (n_tx<MAX_TX && t<HOUR) tx[n_tx++]=t;
+}
+
+static int cmp(const void *a, const void *b) {
+    uint32_t x=*(const uint32_t*)a, y=*(const uint32_t*)b;
+    return x<y ? -1 : x>y;
+}
+
+static uint32_t next_tick(uint32_t t, uint32_t phase, uint32_t period) { //first tick of a free running loop at or after t
+    return t<=phase ? phase : phase+(t-phase+period-1)/period*period;
+}
+
+static uint32_t slot(uint32_t t, uint32_t beat0) { //what radio_slot in main.c rounds t up to
+    return next_tick(t, beat0+CONVERT+100, BEAT);
+}
+
+static void hour(const schedule_t *s, uint32_t *bursts, uint32_t *on) {
+    uint32_t beat0=rand()%BEAT, log_phase=rand()%100, mqtt_phase=rand()%1000, last_sent, t, p;
+    uint32_t pub[HOUR/BEAT+1];
+    int      n_pub=0;
+    n_tx=0;
+    for (uint32_t beat=beat0; beat<HOUR; beat+=BEAT) { //BLOG line and the report channels, queued by state_job
+        uint32_t state=beat+CONVERT;
+        transmit(s->aligned ? state+1 : next_tick(state, log_phase, 100));
+        p=s->aligned ? state+2 : next_tick(state, mqtt_phase, 1000); //the mqtt task takes it from the queue
+        transmit(p); transmit(p+RTT); //publish and puback
+        pub[n_pub++]=p;
+    }
+    //the mqtt task yields once per loop, paho pings when nothing was sent for a keepalive period
+    //LOW_POWER: the loop runs at each publish, at least every third of the keepalive
+    uint32_t loop=s->aligned ? BEAT : 1000, loop0=s->aligned ? beat0+CONVERT+2 : mqtt_phase;
+    last_sent=0;
+    for (int i=0; (t=loop0)<HOUR; loop0+=loop) {
+        while (i<n_pub && pub[i]<=t) last_sent=pub[i++];
+        if (t-last_sent>=(uint32_t)s->keepalive) {transmit(t); transmit(t+RTT); last_sent=t;}
+    }
+    for (t=rand()%60000; t<HOUR; t+=60000+RTT) { //ICMP ping to the hub every 60 s while it answers
+        if (s->aligned) t=slot(t, beat0);
+        transmit(t); transmit(t+RTT);
+    }
+    t=rand()%HOUR; //hourly stats lines
+    transmit(s->aligned ? slot(t, beat0) : t);
+
+    qsort(tx, n_tx, sizeof(tx[0]), cmp);
+    *bursts=*on=0;
+    for (int i=0, start=0; i<n_tx; i++) { //as power_tx does
+        if (i+1==n_tx || tx[i+1]-tx[i]>POWER_TAIL) {
+            (*bursts)++;
+            *on+=tx[i]-tx[start]+POWER_TAIL;
+            start=i+1;
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    static const schedule_t schedule[]={{"default",false,10000},{"LOW_POWER",true,3*BEAT}};
+    int hours=argc>1 ? atoi(argv[1]) : 100;
+
+    if (hours<1) {fprintf(stderr, "usage: radiosim [hours]\n"); return 2;}
+    for (int s=0; s<2; s++) {
+        uint64_t transmits=0, bursts=0, on=0;
+        srand(1);
+        for (int h=0; h<hours; h++) {
+            uint32_t b, o;
+            hour(schedule+s, &b, &o);
+            transmits+=n_tx; bursts+=b; on+=o;
+        }
+        printf("%-9s transmits=%5.0f/h bursts=%5.0f/h radio on=%6.1f s/h duty=%.2f%% plus beacon listening\n",
+                schedule[s].name, (double)transmits/hours, (double)bursts/hours, on/1000.0/hours, on*100.0/hours/HOUR);
+    }
+    return 0;
+}
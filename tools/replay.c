@@ -0,0 +1,215 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Replays recorded UDPlogger captures through control.c and diffs the relay decisions against the log
+ *  replay [-s setpoint] [-y hysteresis] [-r repeat] [-u run] [-o trace] [-v] log|trace...
+ *  a log is the text of the BEAT and EVENT lines of blog-formats.def, as UDPlogger prints them or blogdecode
+ *  decodes them, anything else on a line or between lines is skipped
+ *  -o writes the parsed records as a compact trace (8 bytes per beat) that is read back much faster than the text
+ *  temperatures are stored in 1/16 C, which is what the DS18B20 delivers, so the replay sees the same floats
+ *  as the device and a replay with the firmware parameters must agree on every synced beat
+ *  the device is only in a known state after a boot ("PumpSwitch" line, or the blogdecode uptime going back),
+ *  a capture that starts mid run or has a gap in the uptime follows the logged relay until the exercise
+ *  timer is in phase again: a natural run longer than run, or the first beat of a timed run
+ *  tools/sweep includes this file with REPLAY_LIB for the parser and the trace format
+ *  build and run with: make replay
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../control.h"
+
+#define TRACE_MAGIC   0x54525350 //"PSRT"
+#define TRACE_VERSION 1
+#define NO_TEMP       INT16_MIN  //sensor failure, logged as 99.990
+#define MISMATCHES    20         //listed with -v
+
+enum {R_BEAT, R_EVENT, R_BOOT, R_GAP};
+enum {F_ON=1, F_INHIBITED=2, F_TIMED=4, F_HOMEKIT=8}; //F_HOMEKIT: an event of Active=0, it inhibits for STOP_FOR
+
+typedef struct record {
+    int16_t  t_out, t_in; //in 1/16 C
+    uint16_t inhibit;     //seconds as logged, rounded up to 10
+    uint8_t  flags, kind;
+} record_t;
+_Static_assert(sizeof(record_t)==8, "trace records are 8 bytes");
+
+static record_t *recs;
+static long     n_recs, max_recs;
+static int      beat=10; //seconds, as BEAT in main.c
+
+static void add(record_t r) {
+    if (n_recs==max_recs) {
+        max_recs=max_recs ? 2*max_recs : 65536;
+        if (!(recs=realloc(recs, max_recs*sizeof(record_t)))) {perror("replay"); exit(2);}
+    }
+    recs[n_recs++]=r;
+}
+
+static int16_t sixteenths(float t) {
+    return fabsf(t-CONTROL_NO_TEMP)<0.0005F ? NO_TEMP : (int16_t)lroundf(t*16);
+}
+
+static float degrees(int16_t t) {
+    return t==NO_TEMP ? NAN : t/16.0F;
+}
+
+static void status(record_t *r, const char *s) { //the tail as made by status() in main.c
+    const char *p;
+    int n;
+    if ((p=strstr(s, " inhibited for another ")) && sscanf(p+23, "%d", &n)==1) {r->flags|=F_INHIBITED; r->inhibit=n;}
+    if (strstr(s, " TIMER activated")) r->flags|=F_TIMED;
+}
+
+static double uptime(const char *line, const char *at) { //the number blogdecode puts in front, -1 if none
+    const char *p=at;
+    while (p>line && p[-1]==' ') p--;
+    while (p>line && (p[-1]=='.' || (p[-1]>='0' && p[-1]<='9'))) p--;
+    return p<at && strchr(p, '.') && strchr(p, '.')<at ? atof(p) : -1;
+}
+
+static void parse_text(FILE *f) {
+    static char line[1024];
+    double last=-1, up;
+    float  t_out, t_in;
+    int    on, n;
+    const char *p;
+
+    add((record_t){.kind=R_GAP}); //a new capture, the device state is unknown
+    while (fgets(line, sizeof(line), f)) {
+        record_t r={0};
+        if (strstr(line, "PumpSwitch ")) {add((record_t){.kind=R_BOOT}); last=-1; continue;}
+        if (!(p=strstr(line, " => "))) continue;
+        for (p=strchr(line, 'R'); p; p=strchr(p+1, 'R')) {
+            if (sscanf(p, "R%f - %f C => %d%n", &t_out, &t_in, &on, &n)==3) break;
+        }
+        if (p) {
+            r.kind=R_BEAT;
+            r.t_out=sixteenths(t_out); r.t_in=sixteenths(t_in);
+            if ((up=uptime(line, p))>=0) {
+                if (last>=0 && up<last) add((record_t){.kind=R_BOOT});
+                else if (last>=0 && up-last>1.5*beat) add((record_t){.kind=R_GAP});
+                last=up;
+            }
+        } else if ((p=strstr(line, " => ")) && sscanf(p, " => %d%n", &on, &n)==1) {
+            r.kind=R_EVENT;
+            if (p-line>=7 && !strncmp(p-7, "HomeKit", 7)) r.flags=F_HOMEKIT;
+        } else continue;
+        r.flags|=on ? F_ON : 0;
+        status(&r, p+n);
+        add(r);
+    }
+}
+
+static bool read_trace(FILE *f) {
+    uint32_t h[3];
+    if (fread(h, 4, 3, f)!=3 || h[0]!=TRACE_MAGIC) {rewind(f); return false;}
+    if ((h[1]&0xffff)!=TRACE_VERSION) {fprintf(stderr, "trace version %u\n", h[1]&0xffff); exit(2);}
+    beat=h[1]>>16;
+    while (max_recs<n_recs+h[2]) {
+        max_recs=max_recs ? 2*max_recs : 65536;
+        if (!(recs=realloc(recs, max_recs*sizeof(record_t)))) {perror("replay"); exit(2);}
+    }
+    n_recs+=fread(recs+n_recs, sizeof(record_t), h[2], f);
+    return true;
+}
+
+static void load(const char *name) { //a log or a trace, appended to recs
+    FILE *f=fopen(name, "rb");
+    if (!f) {perror(name); exit(2);}
+    setvbuf(f, NULL, _IOFBF, 1<<20);
+    if (!read_trace(f)) parse_text(f);
+    fclose(f);
+}
+
+#ifndef REPLAY_LIB
+static void write_trace(const char *name) {
+    uint32_t h[3]={TRACE_MAGIC, TRACE_VERSION | beat<<16, n_recs};
+    FILE *f=fopen(name, "wb");
+    if (!f || fwrite(h, 4, 3, f)!=3 || fwrite(recs, sizeof(record_t), n_recs, f)!=(size_t)n_recs || fclose(f)) {
+        perror(name); exit(2);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    control_param_t param={21.5F, 1.0F, 10, 10800, 120};
+    const char *out=NULL;
+    bool     verbose=false, synced=false, was_timed=false;
+    control_t c;
+    int      inhibit=0, a;
+    long     beats=0, events=0, boots=0, gaps=0, warmup=0, compared=0, mismatches=0;
+    long     on_log=0, on_replay=0, switch_log=0, switch_replay=0;
+    bool     last_log=false, last_replay=false;
+
+    for (a=1; a<argc && argv[a][0]=='-'; a++) {
+        if (!strcmp(argv[a], "-v")) {verbose=true; continue;}
+        if (a+1>=argc) break;
+        if      (!strcmp(argv[a], "-s")) param.setpoint  =atof(argv[++a]);
+        else if (!strcmp(argv[a], "-y")) param.hysteresis=atof(argv[++a]);
+        else if (!strcmp(argv[a], "-r")) param.repeat    =atoi(argv[++a]);
+        else if (!strcmp(argv[a], "-u")) param.run       =atoi(argv[++a]);
+        else if (!strcmp(argv[a], "-o")) out=argv[++a];
+        else break;
+    }
+    if (a>=argc) {
+        fprintf(stderr, "usage: replay [-s setpoint] [-y hysteresis] [-r repeat] [-u run] [-o trace] [-v] log|trace...\n");
+        return 2;
+    }
+    for (; a<argc; a++) load(argv[a]);
+    if (out) write_trace(out);
+    param.beat=beat;
+
+    control_init(&c, &param);
+    for (long i=0; i<n_recs; i++) {
+        record_t *r=recs+i;
+        bool logged=r->flags&F_ON, on, warm=!synced;
+        switch (r->kind) {
+            case R_BOOT: boots++; control_init(&c, &param); synced=true;  inhibit=0; was_timed=false; continue;
+            case R_GAP:  gaps++;  synced=false; continue;
+        }
+        //inhibit_left as the device saw it: at least the logged value minus its rounding, it hides behind a TIMER
+        if (r->flags&F_INHIBITED) inhibit=r->inhibit-9;
+        else if (!(r->flags&F_TIMED)) inhibit=0;
+        if (r->kind==R_EVENT) {
+            events++;
+            on=control_apply(&c, inhibit>0);
+        } else {
+            beats++;
+            on=control_beat(&c, degrees(r->t_in), degrees(r->t_out), inhibit>0);
+            inhibit-=beat;
+            if (!synced) { //follow the log until the exercise timer is in phase
+                if ((r->flags&F_TIMED) && !was_timed) {c.timer=param.run; synced=true;}
+                else if (c.prev_on_time>param.run) synced=true;
+            }
+            was_timed=r->flags&F_TIMED;
+        }
+        if (warm) { //including the beat that brought it in phase
+            c.on=logged;
+            if (r->kind==R_BEAT) c.prev_on=logged;
+            warmup++;
+            continue;
+        }
+        compared++;
+        if (r->kind==R_BEAT) {
+            on_log+=logged; on_replay+=on;
+            switch_log+=logged!=last_log; switch_replay+=on!=last_replay;
+            last_log=logged; last_replay=on;
+        }
+        if (on!=logged && mismatches++<MISMATCHES && verbose) {
+            printf("record %8ld %-5s in=%7.3f out=%7.3f logged=%d%s%s replay=%d%s%s\n", i, r->kind==R_BEAT ? "beat" : "event",
+                    degrees(r->t_in), degrees(r->t_out), logged, r->flags&F_INHIBITED ? " inhibited" : "",
+                    r->flags&F_TIMED ? " timed" : "", on, c.inhibited ? " inhibited" : "", c.timed ? " timed" : "");
+        }
+    }
+
+    printf("%ld records: %ld beats (%.1f days), %ld events, %ld boots, %ld gaps, %ld warm-up records\n",
+            n_recs, beats, beats*beat/86400.0, events, boots, gaps, warmup);
+    printf("setpoint=%.3f hysteresis=%.3f repeat=%d run=%d beat=%d\n",
+            param.setpoint, param.hysteresis, param.repeat, param.run, param.beat);
+    printf("%ld of %ld compared decisions differ (%.3f%%)\n", mismatches, compared, compared ? 100.0*mismatches/compared : 0);
+    printf("pump on: logged %.1f h, replay %.1f h; switches: logged %ld, replay %ld\n",
+            on_log*beat/3600.0, on_replay*beat/3600.0, switch_log, switch_replay);
+    return 0;
+}
+#endif //REPLAY_LIB
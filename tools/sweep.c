@@ -0,0 +1,262 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Parameter sweep of control.c over recorded or synthetic temperature traces, ranked per site
+ *  sweep [-s setpoint] [-y hysteresis] [-r repeat] [-u run] [-b beat] [-t stop_for] [-n random] [-H hot]
+ *        [-R reference] [-w on,latency,cycles] [-k top] [-j threads] -S days | log|trace...
+ *  every parameter is a value or from:to:step, the grid is all combinations, -n picks that many of them at random
+ *  scores are relative to the reference, the firmware defaults of main.c unless -R setpoint,hyst,repeat,run,beat,stop
+ *  logs and traces are read as by tools/replay, -S makes a synthetic trace of tap draws instead
+ *  metrics per day: pump on time, relay cycles (off to on), and hot water latency: how long the supply is above
+ *  hot (default the reference setpoint) before the pump runs, averaged over the hot episodes
+ *  the trace is open loop: the recorded temperatures do not react to a different pump schedule
+ *  beat must be a multiple of the beat of the trace, run, repeat and stop_for multiples of beat (see main.c)
+ *  candidates are spread over one deque per thread, an idle thread steals the back half of the fullest deque
+ *  build and run with: make sweep
+ */
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#define REPLAY_LIB
+#include "replay.c"
+
+typedef struct {float from, to, step;} range_t;
+typedef struct {float setpoint, hysteresis; int repeat, run, beat, stop_for;} cand_t;
+typedef struct {cand_t p; double on_h, cycles, latency, score; bool pareto;} result_t;
+typedef struct {pthread_mutex_t lock; long head, tail, steals;} deque_t; //the owner takes the head, thieves the tail
+
+static result_t *results;
+static long     n_results;
+static deque_t  *deques;
+static int      threads;
+static float    hot=NAN;
+static double   days;
+
+static int steps(range_t r) {
+    return r.step>0 && r.to>r.from ? (int)((r.to-r.from)/r.step+1.001) : 1;
+}
+
+static float nth(range_t r, int i) {
+    return r.from+i*r.step;
+}
+
+static range_t parse_range(const char *s) {
+    range_t r={0,0,0};
+    if (sscanf(s, "%f:%f:%f", &r.from, &r.to, &r.step)<3) r.to=r.from, r.step=0;
+    return r;
+}
+
+static bool valid(const cand_t *c) {
+    return c->beat>0 && c->beat%beat==0 && c->run%c->beat==0 && c->repeat%c->beat==0 && c->stop_for%c->beat==0
+        && c->run>0 && c->run<c->repeat && c->hysteresis>=0;
+}
+
+static void evaluate(result_t *res) {
+    const cand_t *p=&res->p;
+    control_param_t cp={p->setpoint, p->hysteresis, p->beat, p->repeat, p->run};
+    control_t c;
+    long     on=0, cycles=0, episodes=0, waited=0, sub=0;
+    int      inhibit=0, every=p->beat/beat;
+    bool     last=false, in_hot=false, served=false;
+
+    control_init(&c, &cp);
+    for (long i=0; i<n_recs; i++) {
+        const record_t *r=recs+i;
+        switch (r->kind) {
+            case R_BOOT: case R_GAP:
+                control_init(&c, &cp); inhibit=0; in_hot=false; sub=0;
+                continue;
+            case R_EVENT: //buttons keep their logged inhibit, HomeKit Active=0 gets stop_for
+                if (r->flags&F_HOMEKIT) inhibit=p->stop_for;
+                else if (r->flags&F_INHIBITED) inhibit=r->inhibit-9;
+                else inhibit=0;
+                if (control_apply(&c, inhibit>0) && !last) cycles++;
+                last=c.on;
+                continue;
+        }
+        if (sub++%every) continue; //a longer beat skips recorded ones
+        bool now=control_beat(&c, degrees(r->t_in), degrees(r->t_out), inhibit>0);
+        inhibit-=p->beat;
+        on+=now;
+        cycles+=now && !last;
+        last=now;
+        if (r->t_in!=NO_TEMP && degrees(r->t_in)>hot) {
+            if (!in_hot) {in_hot=true; served=false; episodes++;}
+            if (now) served=true;
+            else if (!served) waited+=p->beat;
+        } else in_hot=false;
+    }
+    res->on_h   =on*p->beat/3600.0/days;
+    res->cycles =cycles/days;
+    res->latency=episodes ? (double)waited/episodes : 0;
+}
+
+static bool take(int w, long *job) {
+    deque_t *d=deques+w;
+    pthread_mutex_lock(&d->lock);
+    if (d->head<d->tail) {*job=d->head++; pthread_mutex_unlock(&d->lock); return true;}
+    pthread_mutex_unlock(&d->lock);
+    while (1) { //steal the back half of the fullest deque
+        long most=0, lo, n;
+        int  victim=-1;
+        for (int v=0; v<threads; v++) {
+            if (v==w) continue;
+            pthread_mutex_lock(&deques[v].lock);
+            n=deques[v].tail-deques[v].head;
+            pthread_mutex_unlock(&deques[v].lock);
+            if (n>most) {most=n; victim=v;}
+        }
+        if (victim<0) return false;
+        pthread_mutex_lock(&deques[victim].lock);
+        n=deques[victim].tail-deques[victim].head;
+        lo=deques[victim].tail-(n+1)/2;
+        if (n>0) deques[victim].tail=lo;
+        pthread_mutex_unlock(&deques[victim].lock);
+        if (n<=0) continue; //the owner took it meanwhile
+        pthread_mutex_lock(&d->lock);
+        d->head=lo+1; d->tail=lo+(n+1)/2;
+        d->steals++;
+        pthread_mutex_unlock(&d->lock);
+        *job=lo;
+        return true;
+    }
+}
+
+static void *worker(void *arg) {
+    int  w=(intptr_t)arg;
+    long job;
+    while (take(w, &job)) evaluate(results+job);
+    return NULL;
+}
+
+static void synthetic(int n_days) { //tap draws heat the supply, which cools off again in between
+    float t=18;
+    beat=10;
+    add((record_t){.kind=R_BOOT});
+    for (long i=0; i<n_days*86400L/beat; i++) {
+        int  second=i*beat%86400;
+        bool day=second>6*3600 && second<23*3600;
+        if (rand()%(day ? 360 : 3600)==0) t+=3+rand()%5;  //a draw, about 10 a day
+        t+=(18-t)*beat/1200.0F;                            //20 minutes to cool
+        if (rand()%17280==0) add((record_t){.kind=R_EVENT, .flags=F_HOMEKIT | F_INHIBITED, .inhibit=190});
+        add((record_t){sixteenths(30+(rand()%5-2)/16.0F), sixteenths(t+(rand()%5-2)/16.0F), 0, 0, R_BEAT});
+    }
+}
+
+static int by_score(const void *a, const void *b) {
+    double x=((const result_t*)a)->score, y=((const result_t*)b)->score;
+    return x<y ? -1 : x>y;
+}
+
+static void print(const char *rank, const result_t *r) {
+    printf("%-6s %8.3f %5.2f %6d %4d %4d %4d %9.2f %9.1f %10.2f %6.3f\n", rank, r->p.setpoint, r->p.hysteresis,
+            r->p.repeat, r->p.run, r->p.beat, r->p.stop_for, r->on_h, r->latency, r->cycles, r->score);
+}
+
+int main(int argc, char *argv[]) {
+    range_t  s={21.5F,21.5F,0}, y={1.0F,1.0F,0}, rp={10800,10800,0}, u={120,120,0}, b={10,10,0}, t={180,180,0};
+    double   w_on=1, w_lat=1, w_cyc=1, elapsed;
+    int      a, random_n=0, top=20, n_days=0;
+    long     grid, beats=0, events=0, steals=0;
+    result_t ref={.p={21.5F, 1.0F, 10800, 120, 10, 180}}; //SETPOINT HYSTERESIS REPEAT RUN BEAT STOP_FOR
+    uint8_t  *picked;
+    struct timespec t0, t1;
+    pthread_t *tid;
+
+    threads=sysconf(_SC_NPROCESSORS_ONLN);
+    for (a=1; a+1<argc && argv[a][0]=='-'; a+=2) {
+        const char *v=argv[a+1];
+        switch (argv[a][1]) {
+            case 's': s =parse_range(v); break;
+            case 'y': y =parse_range(v); break;
+            case 'r': rp=parse_range(v); break;
+            case 'u': u =parse_range(v); break;
+            case 'b': b =parse_range(v); break;
+            case 't': t =parse_range(v); break;
+            case 'n': random_n=atoi(v); break;
+            case 'H': hot=atof(v); break;
+            case 'R': sscanf(v, "%f,%f,%d,%d,%d,%d", &ref.p.setpoint, &ref.p.hysteresis, &ref.p.repeat, &ref.p.run,
+                              &ref.p.beat, &ref.p.stop_for); break;
+            case 'w': sscanf(v, "%lf,%lf,%lf", &w_on, &w_lat, &w_cyc); break;
+            case 'k': top=atoi(v); break;
+            case 'j': threads=atoi(v); break;
+            case 'S': n_days=atoi(v); break;
+            default:  a=argc; break;
+        }
+    }
+    if (threads<1) threads=1;
+    if (n_days) synthetic(n_days);
+    else if (a>=argc) {
+        fprintf(stderr, "usage: sweep [-s setpoint] [-y hysteresis] [-r repeat] [-u run] [-b beat] [-t stop_for] [-n random] [-H hot]\n"
+                        "             [-R reference] [-w on,latency,cycles] [-k top] [-j threads] -S days | log|trace...\n");
+        return 2;
+    }
+    for (; a<argc; a++) load(argv[a]);
+    for (long i=0; i<n_recs; i++) beats+=recs[i].kind==R_BEAT, events+=recs[i].kind==R_EVENT;
+    if (!beats) {fprintf(stderr, "no beats in the input\n"); return 1;}
+    days=beats*beat/86400.0;
+    if (isnan(hot)) hot=ref.p.setpoint;
+    if (!valid(&ref.p)) {fprintf(stderr, "the reference parameters are not valid for a trace with a beat of %d s\n", beat); return 2;}
+    evaluate(&ref);
+
+    grid=(long)steps(s)*steps(y)*steps(rp)*steps(u)*steps(b)*steps(t);
+    if (random_n<=0 || random_n>grid) random_n=grid;
+    results=malloc(random_n*sizeof(result_t));
+    picked=calloc(grid, 1);
+    for (long i=0; i<random_n; i++) {
+        long k=random_n<grid ? ((long)rand()*RAND_MAX+rand())%grid : i;
+        cand_t c;
+        if (picked[k]) {i--; continue;} //each grid point once
+        picked[k]=1;
+        c.setpoint  =nth(s,  k%steps(s));  k/=steps(s); //mixed radix over the ranges
+        c.hysteresis=nth(y,  k%steps(y));  k/=steps(y);
+        c.repeat    =nth(rp, k%steps(rp)); k/=steps(rp);
+        c.run       =nth(u,  k%steps(u));  k/=steps(u);
+        c.beat      =nth(b,  k%steps(b));  k/=steps(b);
+        c.stop_for  =nth(t,  k%steps(t));
+        if (valid(&c)) results[n_results++].p=c;
+    }
+
+    deques=calloc(threads, sizeof(deque_t));
+    tid=malloc(threads*sizeof(pthread_t));
+    for (int w=0; w<threads; w++) {
+        pthread_mutex_init(&deques[w].lock, NULL);
+        deques[w].head=n_results*w/threads;
+        deques[w].tail=n_results*(w+1)/threads;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int w=0; w<threads; w++) pthread_create(tid+w, NULL, worker, (void*)(intptr_t)w);
+    for (int w=0; w<threads; w++) pthread_join(tid[w], NULL), steals+=deques[w].steals;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    elapsed=t1.tv_sec-t0.tv_sec+(t1.tv_nsec-t0.tv_nsec)/1e9;
+
+    //relative to the reference, with a floor so a metric that is about 0 there does not dominate
+    double on0=fmax(ref.on_h, 0.1), lat0=fmax(ref.latency, 10), cyc0=fmax(ref.cycles, 1);
+    ref.score=w_on*ref.on_h/on0+w_lat*ref.latency/lat0+w_cyc*ref.cycles/cyc0;
+    for (long i=0; i<n_results; i++) {
+        result_t *r=results+i;
+        r->score=w_on*r->on_h/on0+w_lat*r->latency/lat0+w_cyc*r->cycles/cyc0;
+    }
+    qsort(results, n_results, sizeof(result_t), by_score);
+    for (long i=0; i<n_results; i++) { //nobody is at least as good on all three and better on one
+        result_t *r=results+i;
+        r->pareto=true;
+        for (long j=0; j<n_results && r->pareto; j++) {
+            result_t *o=results+j;
+            if (o->on_h<=r->on_h && o->latency<=r->latency && o->cycles<=r->cycles
+                && (o->on_h<r->on_h || o->latency<r->latency || o->cycles<r->cycles)) r->pareto=false;
+        }
+    }
+
+    printf("%.1f days, %ld beats of %d s, %ld events, hot above %.3f C%s\n",
+            days, beats, beat, events, hot, n_days ? ", synthetic" : "");
+    printf("%ld candidates on %d threads in %.2f s, %ld steals\n\n", n_results, threads, elapsed, steals);
+    printf("%-6s %8s %5s %6s %4s %4s %4s %9s %9s %10s %6s\n",
+            "rank", "setpoint", "hyst", "repeat", "run", "beat", "stop", "on h/day", "latency s", "cycles/day", "score");
+    for (long i=0; i<n_results && i<top; i++) {
+        char rank[16];
+        snprintf(rank, sizeof(rank), "%ld%s", i+1, results[i].pareto ? "*" : "");
+        print(rank, results+i);
+    }
+    print("ref", &ref);
+    printf("* on the Pareto front of on time, latency and cycles\n");
+    return 0;
+}
@@ -0,0 +1,136 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Turns the trace stream of a TRACE=1 build into Chrome/Perfetto trace JSON (chrome://tracing, ui.perfetto.dev)
+ *  trace2json [seconds] >trace.json        listens on TRACE_PORT
+ *  trace2json -w raw [seconds]             also saves the packets
+ *  trace2json -r raw >trace.json           converts saved packets
+ *  the 32 bit cycle counter wraps every 53 s at 80 MHz, the stream is unwrapped event by event, which is
+ *  right as long as there is an event at least that often, the beat makes sure of that (27 s at 160 MHz)
+ *  cpufreq puts a CPU_LOW or CPU_HIGH mark just before each switch, the cycles after it count at the new rate;
+ *  at the start and after a lost packet or dropped events, where a mark may be missing, the rate is taken again
+ *  from the first mark of the packet (the clock ran at the other one before it) or else from the mhz in the header
+ *  build with: make trace2json
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "../trace.h"
+#include "../cpufreq.h"
+
+#define EV_NAME(id, name) name,
+static const char *names[]={
+#define TRACE_EV EV_NAME
+#include "../trace-events.def"
+#undef TRACE_EV
+};
+
+static struct {uint16_t task; char name[TRACE_NAME+1];} tasks[64];
+static int      n_tasks, events, lost;
+static uint16_t next_seq;
+static uint32_t last_cycles, dropped;
+static int      mhz;   //the rate the cycle counter runs at
+static double   us;
+static FILE     *raw;
+
+static uint16_t get16(const uint8_t *p) {return p[0] | p[1]<<8;}
+static uint32_t get32(const uint8_t *p) {return p[0] | p[1]<<8 | p[2]<<16 | (uint32_t)p[3]<<24;}
+
+static void task_name(uint16_t task, const char *name) {
+    int i;
+    for (i=0; i<n_tasks && tasks[i].task!=task; i++);
+    if (i==n_tasks) {
+        if (n_tasks==64) return;
+        n_tasks++;
+    }
+    tasks[i].task=task;
+    memcpy(tasks[i].name, name, TRACE_NAME+1);
+}
+
+static void packet(const uint8_t *p, int len) {
+    int count, seq;
+    bool resync;
+    if (len<TRACE_HEADER || get32(p)!=TRACE_MAGIC) return;
+    seq=get16(p+4); count=get16(p+12);
+    resync=!mhz || (events && seq!=next_seq) || get32(p+8)!=dropped;
+    if (events && seq!=next_seq) lost+=(uint16_t)(seq-next_seq);
+    next_seq=seq+1;
+    dropped=get32(p+8);
+    if (resync) { //before the first mark in the packet the clock ran at the other rate, else at that of the header
+        mhz=p[7] ? p[7] : CPUFREQ_LOW;
+        for (int i=0; i<count && TRACE_HEADER+(i+1)*8<=len && p[6]==TRACE_KIND_EVENTS; i++) {
+            int id=p[TRACE_HEADER+i*8+6];
+            if (id==TRACE_CPU_LOW || id==TRACE_CPU_HIGH) {mhz=id==TRACE_CPU_LOW ? CPUFREQ_HIGH : CPUFREQ_LOW; break;}
+        }
+    }
+    if (p[6]==TRACE_KIND_NAMES) {
+        for (int i=0; i<count && TRACE_HEADER+(i+1)*(2+TRACE_NAME)<=len; i++) {
+            const uint8_t *e=p+TRACE_HEADER+i*(2+TRACE_NAME);
+            char name[TRACE_NAME+1]={0};
+            memcpy(name, e+2, TRACE_NAME);
+            task_name(get16(e), name);
+        }
+        return;
+    }
+    for (int i=0; i<count && TRACE_HEADER+(i+1)*8<=len; i++) {
+        const uint8_t *e=p+TRACE_HEADER+i*8;
+        uint32_t cycles=get32(e);
+        int id=e[6], phase=e[7];
+        if (events) us+=(uint32_t)(cycles-last_cycles)/(double)mhz;
+        last_cycles=cycles;
+        printf("%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u%s}", events++ ? "," : "",
+                id<TRACE_EVENTS ? names[id] : "?", "BEi"[phase<3 ? phase : 2], us, get16(e+4),
+                phase==TRACE_I ? ",\"s\":\"t\"" : "");
+        if (id==TRACE_CPU_LOW)  mhz=CPUFREQ_LOW;
+        if (id==TRACE_CPU_HIGH) mhz=CPUFREQ_HIGH;
+    }
+}
+
+static void listen_udp(int seconds) {
+    struct sockaddr_in addr={.sin_family=AF_INET, .sin_port=htons(TRACE_PORT), .sin_addr.s_addr=htonl(INADDR_ANY)};
+    struct timeval tv={1,0};
+    uint8_t buf[1500];
+    int     s=socket(AF_INET, SOCK_DGRAM, 0), one=1, n;
+    time_t  end=time(NULL)+seconds;
+
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (bind(s, (struct sockaddr*)&addr, sizeof(addr))<0) {perror("trace port"); exit(2);}
+    while (time(NULL)<end) {
+        if ((n=recv(s, buf, sizeof(buf), 0))<=0) continue;
+        if (raw) {uint16_t len=n; fwrite(&len, 2, 1, raw); fwrite(buf, 1, n, raw);}
+        packet(buf, n);
+    }
+}
+
+static void read_raw(const char *name) {
+    uint8_t  buf[65536];
+    uint16_t len;
+    FILE *f=fopen(name, "rb");
+    if (!f) {perror(name); exit(2);}
+    while (fread(&len, 2, 1, f)==1 && fread(buf, 1, len, f)==len) packet(buf, len);
+    fclose(f);
+}
+
+int main(int argc, char *argv[]) {
+    int a=1;
+    printf("{\"traceEvents\":[");
+    if (a+1<argc && !strcmp(argv[a],"-r")) read_raw(argv[a+1]);
+    else {
+        if (a+1<argc && !strcmp(argv[a],"-w")) {
+            if (!(raw=fopen(argv[a+1],"wb"))) {perror(argv[a+1]); return 2;}
+            a+=2;
+        }
+        listen_udp(a<argc ? atoi(argv[a]) : 30);
+        if (raw) fclose(raw);
+    }
+    for (int i=0; i<n_tasks; i++) printf("%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+            events++ ? "," : "", tasks[i].task, tasks[i].name);
+    printf("\n],\"displayTimeUnit\":\"ms\"}\n");
+    fprintf(stderr, "%d events, %d tasks, %d packets lost, %u events dropped on the device\n",
+            events-n_tasks, n_tasks, lost, dropped);
+    return 0;
+}
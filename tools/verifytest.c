@@ -0,0 +1,101 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Host test of the streaming OTA check in verify.c
+ *  verifytest main.bin main.bin.sig
+ *  a chunked file source (random 1-1460 byte pieces, like TLS records) feeds verify_update and an emulated flash,
+ *  for the real image and for a truncated, an extended, a corrupted one and a wrong announced length
+ *  reports how far each download got before it was stopped and the flash read pass that is no longer needed
+ *  build and run with: make verifytest
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#define VERIFY_HOST
+#include "../verify.c"
+
+#define FLASH_SIZE 0x100000
+
+static uint8_t  flash[FLASH_SIZE], sig[VERIFY_SIG_LEN];
+static uint8_t *image;
+static long     image_len;
+static uint32_t flash_read; //bytes read back from the emulated flash
+
+static void flash_write(uint32_t addr, const uint8_t *data, int len) {
+    memcpy(flash+addr, data, len);
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+//downloads len bytes of data, announcing 'announced', returns the verify result and how much reached the flash
+static int download(const uint8_t *data, long len, long announced, long *written) {
+    verify_t v;
+    int result;
+    long pos=0;
+
+    *written=0;
+    if ((result=verify_init(&v, sig, sizeof(sig)))) return result;
+    if ((result=verify_length(&v, announced))) return result;
+    while (pos<len) {
+        int chunk=1+rand()%1460;
+        if (chunk>len-pos) chunk=len-pos;
+        if ((result=verify_update(&v, data+pos, chunk))) return result; //stop before writing it
+        flash_write(pos, data+pos, chunk);
+        pos+=chunk; *written=pos;
+    }
+    return verify_final(&v);
+}
+
+static int check(const char *name, const uint8_t *data, long len, long announced, int expect) {
+    long written;
+    int  result=download(data, len, announced, &written);
+    printf("%-10s %-4s result=%2d after %7ld of %7ld bytes were written\n", name, result==expect ? "ok" : "FAIL",
+            result, written, len);
+    return result!=expect;
+}
+
+int main(int argc, char *argv[]) {
+    FILE *f;
+    int  failed=0;
+    long written;
+
+    if (argc!=3) {fprintf(stderr, "usage: verifytest main.bin main.bin.sig\n"); return 2;}
+    if (!(f=fopen(argv[1],"rb"))) {perror(argv[1]); return 2;}
+    fseek(f, 0, SEEK_END); image_len=ftell(f); rewind(f);
+    if (image_len+1024>FLASH_SIZE) {fprintf(stderr, "image too large\n"); return 2;}
+    image=malloc(image_len+1024);
+    if (fread(image, 1, image_len, f)!=(size_t)image_len) {perror(argv[1]); return 2;}
+    fclose(f);
+    memset(image+image_len, 0xa5, 1024);
+    if (!(f=fopen(argv[2],"rb")) || fread(sig, 1, sizeof(sig), f)!=sizeof(sig)) {perror(argv[2]); return 2;}
+    fclose(f);
+    srand(image_len);
+
+    double start=now();
+    failed|=check("good",      image, image_len,      image_len,      VERIFY_OK);
+    double streaming=now()-start;
+    failed|=check("truncated", image, image_len-100,  image_len,      VERIFY_ERR_LENGTH);
+    failed|=check("extended",  image, image_len+1024, image_len,      VERIFY_ERR_LENGTH);
+    failed|=check("announced", image, image_len,      image_len+1024, VERIFY_ERR_LENGTH);
+    image[image_len/2]^=1;
+    failed|=check("corrupted", image, image_len,      image_len,      VERIFY_ERR_HASH);
+    image[image_len/2]^=1;
+
+    start=now(); //the old way: write everything, then read the flash back and hash it
+    download(image, image_len, image_len, &written);
+    verify_t v;
+    verify_init(&v, sig, sizeof(sig));
+    for (long pos=0; pos<image_len; pos+=4096) {
+        int n=image_len-pos<4096 ? image_len-pos : 4096;
+        flash_read+=n;
+        verify_update(&v, flash+pos, n);
+    }
+    verify_final(&v);
+    printf("streaming check %.1f ms, flash read back 0 bytes; afterwards check %.1f ms, flash read back %u bytes\n",
+            streaming*1000, (now()-start)*1000, flash_read);
+    return failed;
+}
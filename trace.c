@@ -0,0 +1,88 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Hot path tracing, see trace.h
+ */
+#ifdef TRACE
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <common_macros.h>
+#include <xtensa_ops.h>
+#include <espressif/esp_system.h>
+#include <espressif/esp_sta.h>
+#include <espressif/esp_wifi.h>
+#include "lwip/sockets.h"
+#include "scheduler.h"
+#include "logsink.h"
+#include "stats.h"
+#include "trace.h"
+
+static trace_event_t ring[TRACE_RING];
+static volatile uint32_t head=0, tail=0, dropped=0; //free running, producers move head, the job moves tail
+static uint32_t packet[(TRACE_HEADER+TRACE_BATCH*sizeof(trace_event_t))/4];
+static uint16_t seq;
+static int      sock=-1;
+
+void IRAM trace_event(int id, int phase) {
+    uint16_t task=(uintptr_t)xTaskGetCurrentTaskHandle()>>2;
+    trace_event_t *e;
+    taskENTER_CRITICAL(); //the cycle count is taken inside, so the ring is in time order
+    if (head-tail>=TRACE_RING) dropped++;
+    else {
+        e=ring+head%TRACE_RING;
+        RSR(e->cycles, ccount);
+        e->task=task; e->id=id; e->phase=phase;
+        head++;
+    }
+    taskEXIT_CRITICAL();
+}
+
+static void send(int kind, int count, int len) {
+    struct sockaddr_in to={.sin_family=AF_INET, .sin_port=htons(TRACE_PORT), .sin_addr.s_addr=htonl(INADDR_BROADCAST)};
+    uint8_t *h=(uint8_t*)packet;
+    packet[0]=TRACE_MAGIC;
+    h[4]=seq; h[5]=seq>>8; seq++;
+    h[6]=kind;
+    h[7]=sdk_system_get_cpu_freq();
+    packet[2]=dropped;
+    h[12]=count; h[13]=count>>8; h[14]=h[15]=0;
+    if (sock<0) sock=lwip_socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock>=0) lwip_sendto(sock, packet, TRACE_HEADER+len, 0, (struct sockaddr*)&to, sizeof(to));
+}
+
+static void send_names(void) {
+    TaskStatus_t *status;
+    uint8_t *p=(uint8_t*)packet+TRACE_HEADER;
+    int n=stats_tasks(&status);
+    if (n>TRACE_BATCH*sizeof(trace_event_t)/(2+TRACE_NAME)) n=TRACE_BATCH*sizeof(trace_event_t)/(2+TRACE_NAME);
+    for (int i=0; i<n; i++, p+=2+TRACE_NAME) {
+        uint16_t task=(uintptr_t)status[i].xHandle>>2;
+        p[0]=task; p[1]=task>>8;
+        strncpy((char*)p+2, status[i].pcTaskName, TRACE_NAME);
+    }
+    send(TRACE_KIND_NAMES, n, n*(2+TRACE_NAME));
+}
+
+static void trace_job(void *arg) {
+    static int runs=0;
+    if (sdk_wifi_station_get_connect_status()!=STATION_GOT_IP) return; //the ring holds what fits meanwhile
+    if (!(runs++%TRACE_NAMES)) send_names();
+    while (tail!=head) {
+        int n=head-tail;
+        if (n>TRACE_BATCH) n=TRACE_BATCH;
+        for (int i=0; i<n; i++) ((trace_event_t*)(packet+TRACE_HEADER/4))[i]=ring[(tail+i)%TRACE_RING];
+        tail+=n;
+        send(TRACE_KIND_EVENTS, n, n*sizeof(trace_event_t));
+    }
+}
+static sched_job_t tracer=SCHED_JOB(trace_job,NULL);
+
+void trace_init(void) {
+    uint32_t start, end;
+    RSR(start, ccount);
+    for (int i=0; i<8; i++) trace_event(TRACE_BEAT, TRACE_I);
+    RSR(end, ccount);
+    head=tail=dropped=0; //only there to measure
+    LOG_I("trace: %u cycles per event, ring of %d events to UDP port %d\n", (end-start)/8, TRACE_RING, TRACE_PORT);
+    sched_add(&tracer, TRACE_PERIOD, TRACE_PERIOD);
+}
+#endif //TRACE
@@ -0,0 +1,58 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Hot path tracing with the CCOUNT cycle counter (make TRACE=1)
+ *  TRACE_BEGIN(id), TRACE_END(id) and TRACE_MARK(id) with an id from trace-events.def put an 8 byte record
+ *  into a RAM ring, a scheduler job sends the ring every TRACE_PERIOD ms to UDP port TRACE_PORT and now and then
+ *  the task names, tools/trace2json turns that into Chrome/Perfetto trace JSON
+ *  without TRACE the macros are empty, with TRACE an event costs one call and a short critical section,
+ *  trace_init logs the measured cycles per event
+ *  task context only, not from interrupts; when the ring is full events are dropped and counted
+ */
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+
+#define TRACE_PORT   45680
+#define TRACE_MAGIC  0x31435254 //"TRC1"
+#define TRACE_HEADER 16         //magic, seq, kind, mhz, dropped, count
+#ifndef TRACE_RING
+#define TRACE_RING   64         //events, power of 2
+#endif
+#define TRACE_BATCH  32         //events per packet
+#define TRACE_PERIOD 50         //in milliseconds
+#define TRACE_NAMES  100        //send the task names every so many periods
+#define TRACE_NAME   14         //chars of a task name in the names packet
+
+enum {TRACE_B, TRACE_E, TRACE_I};            //phase, as in the Chrome trace format
+enum {TRACE_KIND_EVENTS, TRACE_KIND_NAMES};  //packet kinds
+
+typedef struct trace_event {
+    uint32_t cycles;
+    uint16_t task;  //handle>>2, names come in a TRACE_KIND_NAMES packet as {task, name[TRACE_NAME]}
+    uint8_t  id;
+    uint8_t  phase;
+} trace_event_t;
+
+#define TRACE_EV(id, name) TRACE_##id,
+enum {
+#include "trace-events.def"
+    TRACE_EVENTS
+};
+#undef TRACE_EV
+
+#ifdef TRACE
+#define TRACE_RAM (TRACE_RING*sizeof(trace_event_t)+TRACE_HEADER+TRACE_BATCH*sizeof(trace_event_t))
+void trace_init(void);
+void trace_event(int id, int phase);
+#define TRACE_BEGIN(id) trace_event(TRACE_##id, TRACE_B)
+#define TRACE_END(id)   trace_event(TRACE_##id, TRACE_E)
+#define TRACE_MARK(id)  trace_event(TRACE_##id, TRACE_I)
+#else
+#define TRACE_RAM 0
+#define trace_init()    do {} while(0)
+#define TRACE_BEGIN(id) do {} while(0)
+#define TRACE_END(id)   do {} while(0)
+#define TRACE_MARK(id)  do {} while(0)
+#endif
+
+#endif // __TRACE_H__
@@ -0,0 +1,63 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Streaming check of an OTA image, see verify.h
+ */
+#include <string.h>
+#include "verify.h"
+
+#ifdef VERIFY_HOST
+ #define sha_init(s)          (SHA384_Init(s)!=1)
+ #define sha_update(s, d, n)  (SHA384_Update(s, d, n)!=1)
+ #define sha_final(s, h)      (SHA384_Final(h, s)!=1)
+ #define cpufreq_hold(r)
+ #define cpufreq_release(r)
+#else
+ #include "cpufreq.h"
+ #define sha_init(s)          wc_InitSha384(s)
+ #define sha_update(s, d, n)  wc_Sha384Update(s, d, n)
+ #define sha_final(s, h)      wc_Sha384Final(s, h)
+#endif
+
+static int reject(verify_t *v, int error) {
+    cpufreq_release(CPUFREQ_OTA);
+    return v->error=error;
+}
+
+int verify_init(verify_t *v, const uint8_t *sig, int sig_len) {
+    memset(v, 0, sizeof(verify_t));
+    cpufreq_hold(CPUFREQ_OTA); //the chunks are hashed at 160 MHz until final or an error
+    if (sig_len!=VERIFY_SIG_LEN) return reject(v, VERIFY_ERR_SIG);
+    memcpy(v->hash, sig, VERIFY_HASH_LEN);
+    sig+=VERIFY_HASH_LEN;
+    v->length=(uint32_t)sig[0]<<24 | sig[1]<<16 | sig[2]<<8 | sig[3];
+    if (sha_init(&v->sha)) return reject(v, VERIFY_ERR_STATE);
+    return VERIFY_OK;
+}
+
+int verify_length(verify_t *v, uint32_t announced) {
+    if (v->error) return VERIFY_ERR_STATE;
+    if (announced!=v->length) return reject(v, VERIFY_ERR_LENGTH);
+    return VERIFY_OK;
+}
+
+int verify_update(verify_t *v, const uint8_t *data, int len) {
+    if (v->error) return VERIFY_ERR_STATE;
+    if (len>0 && (uint32_t)len>v->length-v->received) return reject(v, VERIFY_ERR_LENGTH); //do not write what we will not boot
+    v->received+=len;
+    if (len>0 && sha_update(&v->sha, data, len)) return reject(v, VERIFY_ERR_STATE);
+    return VERIFY_OK;
+}
+
+int verify_final(verify_t *v) {
+    uint8_t hash[VERIFY_HASH_LEN];
+    if (v->error) return VERIFY_ERR_STATE;
+    if (v->received!=v->length) return reject(v, VERIFY_ERR_LENGTH);
+    v->error=VERIFY_ERR_STATE; //once
+    cpufreq_release(CPUFREQ_OTA);
+    if (sha_final(&v->sha, hash)) return VERIFY_ERR_STATE;
+    if (memcmp(hash, v->hash, VERIFY_HASH_LEN)) return v->error=VERIFY_ERR_HASH;
+    return VERIFY_OK;
+}
+
+void verify_abort(verify_t *v) {
+    if (!v->error) reject(v, VERIFY_ERR_STATE);
+}
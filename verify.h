@@ -0,0 +1,43 @@
+/*  (c) 2022 HomeAccessoryKid
+ *  Streaming check of an OTA image against its main.bin.sig (sha384 plus 32 bit big endian length, see make sig)
+ *  fetch the small sig file first, then hash every chunk on its way to flash, so no second pass reads the flash
+ *  a download that announces or delivers a different length is stopped at once
+ *  download loop: verify_init(sig) verify_length(content_length) {verify_update(chunk) write(chunk)} verify_final
+ *  a download that gives up for another reason, e.g. the network, calls verify_abort so the CPU drops to 80 MHz
+ */
+#ifndef __VERIFY_H__
+#define __VERIFY_H__
+
+#include <stdint.h>
+
+#ifdef VERIFY_HOST //tools build against openssl
+ #include <openssl/sha.h>
+ typedef SHA512_CTX verify_sha_t;
+#else
+ #include <wolfssl/wolfcrypt/sha512.h>
+ typedef wc_Sha384 verify_sha_t;
+#endif
+
+#define VERIFY_HASH_LEN  48
+#define VERIFY_SIG_LEN   (VERIFY_HASH_LEN+4)
+
+#define VERIFY_OK          0
+#define VERIFY_ERR_SIG    -1 //sig file has the wrong size
+#define VERIFY_ERR_LENGTH -2 //more or fewer bytes than the sig says
+#define VERIFY_ERR_HASH   -3
+#define VERIFY_ERR_STATE  -4 //an earlier error, or final was already called
+
+typedef struct verify {
+    verify_sha_t sha;
+    uint8_t  hash[VERIFY_HASH_LEN];
+    uint32_t length, received;
+    int      error;
+} verify_t;
+
+int verify_init(verify_t *v, const uint8_t *sig, int sig_len);
+int verify_length(verify_t *v, uint32_t announced); //e.g. the Content-Length, before downloading anything
+int verify_update(verify_t *v, const uint8_t *data, int len);
+int verify_final(verify_t *v);
+void verify_abort(verify_t *v);  //after an error of verify it is a no-op
+
+#endif // __VERIFY_H__